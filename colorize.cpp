@@ -0,0 +1,108 @@
+#include "colorize.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+const int builtinPaletteSize = 256;
+
+struct CosinePalette {
+    const char* name;
+    float frequency;   // phase multiplier
+    float offsets[3];  // per channel
+    bool sine;
+};
+
+// The palettes the shaders used to evaluate per pixel
+const CosinePalette cosinePalettes[] = {
+    {"rainbow", 1.0f, {0.0f, 0.6f, 1.0f}, false},
+    {"fiery", 1.0f, {0.0f, 0.1f, 0.2f}, false},
+    {"ocean", 1.0f, {0.5f, 0.6f, 0.0f}, false},
+    {"grayscale", 1.0f, {0.0f, 0.0f, 0.0f}, false},
+    {"electric", 2.0f, {0.0f, 0.3f, 0.6f}, false},
+    {"neon", 1.0f, {0.0f, 2.0f, 4.0f}, true},
+    {"gold", 1.0f, {0.1f, 0.2f, 0.5f}, false},
+};
+
+} // namespace
+
+std::vector<Palette> builtinPalettes() {
+    std::vector<Palette> palettes;
+    for (const CosinePalette& cosine : cosinePalettes) {
+        Palette palette;
+        palette.name = cosine.name;
+        palette.rgb.resize(builtinPaletteSize * 3);
+        for (int i = 0; i < builtinPaletteSize; i++) {
+            float t = (i + 0.5f) / builtinPaletteSize * palettePeriod;
+            for (int c = 0; c < 3; c++) {
+                float v = cosine.sine ? 0.5f + 0.5f * std::sin(t + cosine.offsets[c])
+                                      : 0.5f + 0.5f * std::cos(3.0f + t * cosine.frequency + cosine.offsets[c]);
+                palette.rgb[i * 3 + c] = toUnorm8(v);
+            }
+        }
+        palettes.push_back(palette);
+    }
+    return palettes;
+}
+
+bool loadPalette(const std::string& path, Palette& palette) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Failed to open palette " << path << std::endl;
+        return false;
+    }
+    palette.rgb.clear();
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(in, line)) {
+        lineNumber++;
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        int r, g, b;
+        if (!(fields >> r)) continue;
+        if (!(fields >> g >> b) || r < 0 || r > 255 || g < 0 || g > 255 || b < 0 || b > 255) {
+            std::cerr << path << ":" << lineNumber << ": expected r g b in 0-255" << std::endl;
+            return false;
+        }
+        palette.rgb.push_back((uint8_t)r);
+        palette.rgb.push_back((uint8_t)g);
+        palette.rgb.push_back((uint8_t)b);
+    }
+    if (palette.size() < 2) {
+        std::cerr << path << ": a palette needs at least two entries" << std::endl;
+        return false;
+    }
+    palette.name = std::filesystem::path(path).stem().string();
+    return true;
+}
+
+std::vector<Palette> loadPalettes(const std::string& directory) {
+    std::vector<std::filesystem::path> files;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(directory, ec)) {
+        if (entry.path().extension() == ".lut") files.push_back(entry.path());
+    }
+    std::sort(files.begin(), files.end());
+
+    std::vector<Palette> palettes;
+    for (const std::filesystem::path& file : files) {
+        Palette palette;
+        if (loadPalette(file.string(), palette)) palettes.push_back(palette);
+    }
+    return palettes;
+}
+
+void buildCdf(const uint64_t* bins, float* cdf) {
+    uint64_t total = 0;
+    for (int i = 0; i < histogramBins; i++) total += bins[i];
+    double scale = total ? 1.0 / total : 0.0;
+    uint64_t running = 0;
+    for (int i = 0; i < histogramBins; i++) {
+        running += bins[i];
+        cdf[i] = (float)(running * scale);
+    }
+}
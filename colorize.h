@@ -0,0 +1,136 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// CPU twin of coloringSource in shaders.cpp. Input is the smooth escape count
+// (maxIterations for interior points), output is packed 8-bit RGB.
+
+// Palette phase covered by one pass through a palette's lookup table
+const float palettePeriod = 6.28318531f;
+
+// Color lookup table over one period of palette phase. Entry i sits at phase
+// (i + 0.5) / size * palettePeriod, like the texels of the GL texture it is
+// uploaded to, and sample() filters like GL_LINEAR with GL_REPEAT.
+struct Palette {
+    std::string name;
+    std::vector<uint8_t> rgb;  // packed entries
+
+    int size() const { return (int)(rgb.size() / 3); }
+
+    void sample(float t, float* color) const {
+        int n = size();
+        float x = t / palettePeriod * (float)n - 0.5f;
+        float whole = std::floor(x);
+        float f = x - whole;
+        int i0 = ((int)whole % n + n) % n;
+        int i1 = (i0 + 1) % n;
+        for (int c = 0; c < 3; c++)
+            color[c] = ((float)rgb[i0 * 3 + c] * (1.0f - f) + (float)rgb[i1 * 3 + c] * f) * (1.0f / 255.0f);
+    }
+};
+
+// The original seven cosine palettes, tabulated
+std::vector<Palette> builtinPalettes();
+
+// A palette file is text: one "r g b" line (0-255) per entry, at least two
+// entries, and # starts a comment. The palette is named after the file.
+bool loadPalette(const std::string& path, Palette& palette);
+// Every *.lut file in directory, sorted by file name; empty if there are none
+std::vector<Palette> loadPalettes(const std::string& directory);
+
+inline uint8_t toUnorm8(float v) {
+    return (uint8_t)std::lround(std::min(std::max(v, 0.0f), 1.0f) * 255.0f);
+}
+
+// Colors a buffer of smooth counts with a palette. Unlike the shaders'
+// CONTRAST_ENHANCE variants this takes contrastEnhance at run time: it only
+// sets colorFreq once per buffer, so the per-pixel loop is the same either way.
+struct Colorizer {
+    const Palette* palette = nullptr;
+    bool contrastEnhance = false;
+    // Enhance contrast for this zoom rather than the view's, if set
+    double zoom = 0.0;
+
+    void operator()(const float* mu, size_t count, int maxIterations, double viewZoom, uint8_t* rgb) const {
+        // Increase color frequency as we zoom in to maintain contrast/detail
+        float colorFreq = 0.1f;
+        if (contrastEnhance) {
+            float zoomLog = std::max(0.0f, (float)(-std::log((float)(zoom > 0.0 ? zoom : viewZoom)) / std::log(10.0f)));
+            colorFreq += zoomLog * 0.05f;
+        }
+
+        for (size_t i = 0; i < count; i++, rgb += 3) {
+            if (mu[i] >= (float)maxIterations) {
+                rgb[0] = rgb[1] = rgb[2] = 0;
+                continue;
+            }
+            float color[3];
+            palette->sample((mu[i] + 4.0f) * colorFreq, color);
+            rgb[0] = toUnorm8(color[0]);
+            rgb[1] = toUnorm8(color[1]);
+            rgb[2] = toUnorm8(color[2]);
+        }
+    }
+
+    bool operator==(const Colorizer& other) const {
+        return palette == other.palette && contrastEnhance == other.contrastEnhance && zoom == other.zoom;
+    }
+};
+
+// Distance estimation shading: exterior pixels closer to the set than
+// distanceShadeWidth pixels fade to black, so the boundary and its filaments
+// are drawn at the same width at any zoom and resolution
+const float distanceShadeWidth = 2.0f;
+
+inline float distanceShade(float distance) {
+    float t = std::min(std::max(distance / distanceShadeWidth, 0.0f), 1.0f);
+    return t * t * (3.0f - 2.0f * t);
+}
+
+inline void shadeByDistance(const float* distance, size_t count, uint8_t* rgb) {
+    for (size_t i = 0; i < count; i++, rgb += 3) {
+        float shade = distanceShade(distance[i]);
+        for (int c = 0; c < 3; c++) rgb[c] = toUnorm8((float)rgb[c] * (1.0f / 255.0f) * shade);
+    }
+}
+
+// Histogram coloring: the palette is indexed by the share of escaped pixels
+// with a lower count instead of by the count itself, so the colors spread over
+// whatever range of counts the view has at any zoom. Escaped pixels are binned
+// by mu / maxIterations; cdf[i] is the share of them in bins 0..i.
+const int histogramBins = 4096;
+// Palette phase covered from the lowest to the highest count
+const float histogramRange = 12.0f;
+
+inline int histogramBin(float mu, int maxIterations) {
+    int bin = (int)(std::max(mu, 0.0f) / (float)maxIterations * (float)histogramBins);
+    return std::min(bin, histogramBins - 1);
+}
+
+// Inclusive prefix sum of bins, normalized to 0..1
+void buildCdf(const uint64_t* bins, float* cdf);
+
+inline void colorizeEqualized(const Palette& palette, const float* mu, size_t count, int maxIterations,
+                              const float* cdf, uint8_t* rgb) {
+    for (size_t i = 0; i < count; i++, rgb += 3) {
+        if (mu[i] >= (float)maxIterations) {
+            rgb[0] = rgb[1] = rgb[2] = 0;
+            continue;
+        }
+        // Interpolated within the bin so the bands stay smooth
+        float x = std::min(std::max(mu[i], 0.0f) / (float)maxIterations, 1.0f) * (float)histogramBins;
+        int bin = histogramBin(mu[i], maxIterations);
+        float below = bin > 0 ? cdf[bin - 1] : 0.0f;
+        float share = below + (cdf[bin] - below) * (x - (float)bin);
+        float color[3];
+        palette.sample(share * histogramRange, color);
+        rgb[0] = toUnorm8(color[0]);
+        rgb[1] = toUnorm8(color[1]);
+        rgb[2] = toUnorm8(color[2]);
+    }
+}
@@ -0,0 +1,275 @@
+#pragma once
+
+#include <cmath>
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "orbit.h"
+#include "view_params.h"
+
+// CPU twin of iterationSource in shaders.cpp, so CPU and GPU engines agree
+// pixel for pixel up to rounding.
+
+struct CpuView {
+    double centerX = 0.0, centerY = 0.0;
+    double zoom = 1.0;
+    int width = 0, height = 0;
+    int maxIterations = 256;
+    // Reference orbit near the center for perturbation, or null for direct iteration
+    std::shared_ptr<const ReferenceOrbit> orbit;
+    // Also track dz/dc and estimate each pixel's distance to the set
+    bool distanceEstimate = false;
+};
+
+// What the kernel needs of view; orbit is required for perturbed() views
+inline CpuView cpuView(const ViewParams& view, std::shared_ptr<const ReferenceOrbit> orbit = nullptr) {
+    CpuView cpu;
+    cpu.centerX = view.centerX;
+    cpu.centerY = view.centerY;
+    cpu.zoom = view.zoom;
+    cpu.width = view.width;
+    cpu.height = view.height;
+    cpu.maxIterations = view.maxIterations;
+    cpu.orbit = std::move(orbit);
+    cpu.distanceEstimate = view.distanceEstimate;
+    return cpu;
+}
+
+// Periodicity detection: z is compared against a copy saved at iterations 1,
+// 2, 4, 8, ... and a point whose orbit returns to within this many pixel
+// widths of the copy is taken to have settled on an attracting cycle
+const double periodTolerance = 1e-3;
+
+// The cycle a point settled on, as found by periodicity detection
+struct Cycle {
+    int period = 0;  // 0 if the point escaped or ran out of iterations
+    double zRe = 0.0, zIm = 0.0;  // near a point of the cycle
+};
+
+// Smooth escape count at (fx, fy) in pixels, counted from the bottom-left like
+// gl_FragCoord; maxIterations for points that never escaped. The raw
+// iteration count is returned through iterations for cost accounting. Points
+// caught by periodicity detection stop early and count as never escaping; if
+// cycle is given it receives what they settled on.
+//
+// With Distance the derivative dz/dc is iterated alongside z, and distance
+// receives the exterior distance estimate |z| ln|z| / 2|dz/dc| in pixels (0
+// for points that never escaped). The derivative is of the full z, so it
+// carries through perturbation and rebasing unchanged.
+template <bool Distance>
+inline float iteratePoint(const CpuView& view, float fx, float fy, int& iterations, float* distance,
+                          Cycle* cycle = nullptr) {
+    // Pixel offsets are single precision in the shaders; only the product with zoom is double
+    float minRes = (float)(view.width < view.height ? view.width : view.height);
+    double uvX = (fx - 0.5f * (float)view.width) / minRes;
+    double uvY = (fy - 0.5f * (float)view.height) / minRes;
+
+    double zRe = 0.0, zIm = 0.0;
+    double derRe = 0.0, derIm = 0.0;
+    int iter = 0;
+    const int maxIter = view.maxIterations;
+    double checkRe = 0.0, checkIm = 0.0;
+    int checkIter = 0, nextCheck = 1, period = 0;
+    const double tolerance = periodTolerance * view.zoom / minRes;
+    const double tolerance2 = tolerance * tolerance;
+    if (view.orbit) {
+        // Iterate the offset dz from the reference orbit Z: z = Z + dz
+        const double* orbitZ = view.orbit->z.data();
+        const int orbitLength = view.orbit->length();
+        double cRe = view.centerX - view.orbit->centerX + uvX * view.zoom;
+        double cIm = view.centerY - view.orbit->centerY + uvY * view.zoom;
+        double dzRe = 0.0, dzIm = 0.0;
+        int m = 0;
+        while (zRe * zRe + zIm * zIm < 16.0 && iter < maxIter) {
+            if (Distance) {
+                double nextRe = 2.0 * (zRe * derRe - zIm * derIm) + 1.0;
+                derIm = 2.0 * (zRe * derIm + zIm * derRe);
+                derRe = nextRe;
+            }
+            double ZRe = orbitZ[2 * m], ZIm = orbitZ[2 * m + 1];
+            double nextRe = 2.0 * (ZRe * dzRe - ZIm * dzIm) + dzRe * dzRe - dzIm * dzIm + cRe;
+            dzIm = 2.0 * (ZRe * dzIm + ZIm * dzRe + dzRe * dzIm) + cIm;
+            dzRe = nextRe;
+            m++;
+            zRe = orbitZ[2 * m] + dzRe;
+            zIm = orbitZ[2 * m + 1] + dzIm;
+            iter++;
+            // Rebase onto the start of the orbit once it stops being a good approximation
+            if (zRe * zRe + zIm * zIm < dzRe * dzRe + dzIm * dzIm || m == orbitLength - 1) {
+                dzRe = zRe;
+                dzIm = zIm;
+                m = 0;
+            }
+            double driftRe = zRe - checkRe, driftIm = zIm - checkIm;
+            if (driftRe * driftRe + driftIm * driftIm < tolerance2) {
+                period = iter - checkIter;
+                break;
+            }
+            if (iter == nextCheck) {
+                checkRe = zRe;
+                checkIm = zIm;
+                checkIter = iter;
+                nextCheck *= 2;
+            }
+        }
+    } else {
+        double cRe = view.centerX + uvX * view.zoom;
+        double cIm = view.centerY + uvY * view.zoom;
+        while (zRe * zRe + zIm * zIm < 16.0 && iter < maxIter) {
+            if (Distance) {
+                double nextRe = 2.0 * (zRe * derRe - zIm * derIm) + 1.0;
+                derIm = 2.0 * (zRe * derIm + zIm * derRe);
+                derRe = nextRe;
+            }
+            double nextRe = zRe * zRe - zIm * zIm + cRe;
+            zIm = 2.0 * zRe * zIm + cIm;
+            zRe = nextRe;
+            iter++;
+            double driftRe = zRe - checkRe, driftIm = zIm - checkIm;
+            if (driftRe * driftRe + driftIm * driftIm < tolerance2) {
+                period = iter - checkIter;
+                break;
+            }
+            if (iter == nextCheck) {
+                checkRe = zRe;
+                checkIm = zIm;
+                checkIter = iter;
+                nextCheck *= 2;
+            }
+        }
+    }
+
+    iterations = iter;
+    if (period > 0 || iter >= maxIter) {
+        if (cycle) {
+            cycle->period = period;
+            cycle->zRe = zRe;
+            cycle->zIm = zIm;
+        }
+        if (Distance) *distance = 0.0f;
+        return (float)maxIter;
+    }
+    if (cycle) cycle->period = 0;
+    double radius = std::sqrt(zRe * zRe + zIm * zIm);
+    if (Distance) {
+        double estimate = 0.5 * radius * std::log(radius) / std::sqrt(derRe * derRe + derIm * derIm);
+        *distance = (float)(estimate * minRes / view.zoom);
+    }
+    return (float)(iter - std::log2(std::log2(radius)));
+}
+
+// Radius in pixels of a disc around (fx, fy) that lies entirely inside the set,
+// from the interior distance estimate of the attracting cycle the point settled
+// on; 0 if there is none. Newton's method first pulls the cycle's point onto
+// the exact cycle, then the derivatives of f^p at it bound the distance to the
+// boundary from below by a quarter of
+//
+//     (1 - |dz/dz|^2) / |d2z/dcdz + d2z/dz2 dz/dc / (1 - dz/dz)|
+//
+// Direct iteration only: past double precision c itself isn't exact enough to
+// place the disc, so perturbed views get 0.
+inline float interiorRadius(const CpuView& view, float fx, float fy, const Cycle& cycle) {
+    if (cycle.period <= 0 || view.orbit) return 0.0f;
+    typedef std::complex<double> Complex;
+    float minRes = (float)(view.width < view.height ? view.width : view.height);
+    double uvX = (fx - 0.5f * (float)view.width) / minRes;
+    double uvY = (fy - 0.5f * (float)view.height) / minRes;
+    const Complex c(view.centerX + uvX * view.zoom, view.centerY + uvY * view.zoom);
+
+    Complex z0(cycle.zRe, cycle.zIm);
+    for (int step = 0; step < 16; step++) {
+        Complex z = z0, dz = 1.0;
+        for (int i = 0; i < cycle.period; i++) {
+            dz = 2.0 * z * dz;
+            z = z * z + c;
+        }
+        Complex delta = (z - z0) / (dz - 1.0);
+        z0 -= delta;
+        if (std::norm(delta) < 1e-28 * std::norm(z0) + 1e-300) break;
+    }
+    // Detection can return a multiple of the period, when the orbit was not yet
+    // close enough after one trip around the cycle; the bound needs the true one
+    int period = cycle.period;
+    Complex z = z0;
+    for (int i = 1; i < cycle.period; i++) {
+        z = z * z + c;
+        if (std::norm(z - z0) < 1e-20 * (1.0 + std::norm(z0))) {
+            period = i;
+            break;
+        }
+    }
+
+    z = z0;
+    Complex dz = 1.0, dc = 0.0, dzdz = 0.0, dcdz = 0.0;
+    for (int i = 0; i < period; i++) {
+        dcdz = 2.0 * (z * dcdz + dc * dz);
+        dzdz = 2.0 * (dz * dz + z * dzdz);
+        dc = 2.0 * z * dc + 1.0;
+        dz = 2.0 * z * dz;
+        z = z * z + c;
+    }
+    double multiplier = std::norm(dz);
+    if (!(multiplier < 1.0)) return 0.0f;
+    double bound = (1.0 - multiplier) / std::abs(dcdz + dzdz * dc / (1.0 - dz));
+    if (!std::isfinite(bound)) return 0.0f;
+    return (float)(0.25 * bound * minRes / view.zoom);
+}
+
+inline float getIterationsAt(const CpuView& view, float fx, float fy, int& iterations) {
+    return iteratePoint<false>(view, fx, fy, iterations, nullptr);
+}
+
+// At the center of pixel (px, py)
+inline float getIterations(const CpuView& view, int px, int py, int& iterations) {
+    return getIterationsAt(view, (float)px + 0.5f, (float)py + 0.5f, iterations);
+}
+
+// A disc of pixels known to be inside the set, from interiorRadius()
+struct InteriorDisc {
+    float x, y;
+    float radius2;
+};
+
+// Per block; a tile-sized block rarely needs more than a handful to cover its interior
+const int maxInteriorDiscs = 32;
+
+// Iterates the width x height pixels of the view whose bottom-left one is
+// (x0, y0), at pixel centers. mu, count and, if the view asks for distance
+// estimation, distance point at that pixel, with rows stride elements apart.
+// A pixel that settles on an attracting cycle marks a disc around it as
+// interior, and the block's later pixels inside the disc are not iterated at
+// all. Returns the iterations performed.
+inline uint64_t iterateBlock(const CpuView& view, int x0, int y0, int width, int height, size_t stride, float* mu,
+                             uint32_t* count, float* distance) {
+    InteriorDisc discs[maxInteriorDiscs];
+    int discCount = 0;
+    uint64_t total = 0;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            float fx = (float)(x0 + x) + 0.5f, fy = (float)(y0 + y) + 0.5f;
+            size_t i = (size_t)y * stride + x;
+            bool inside = false;
+            for (int k = 0; k < discCount && !inside; k++) {
+                float dx = fx - discs[k].x, dy = fy - discs[k].y;
+                inside = dx * dx + dy * dy < discs[k].radius2;
+            }
+            if (inside) {
+                mu[i] = (float)view.maxIterations;
+                count[i] = 0;
+                if (distance) distance[i] = 0.0f;
+                continue;
+            }
+            int iterations;
+            Cycle cycle;
+            if (distance) mu[i] = iteratePoint<true>(view, fx, fy, iterations, &distance[i], &cycle);
+            else mu[i] = iteratePoint<false>(view, fx, fy, iterations, nullptr, &cycle);
+            count[i] = iterations;
+            total += iterations;
+            float radius = interiorRadius(view, fx, fy, cycle);
+            if (radius >= 1.0f && discCount < maxInteriorDiscs) discs[discCount++] = {fx, fy, radius * radius};
+        }
+    }
+    return total;
+}
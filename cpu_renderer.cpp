@@ -0,0 +1,301 @@
+#include "cpu_renderer.h"
+
+#include <algorithm>
+#include <cmath>
+
+CpuRenderer::CpuRenderer(int threadCount) : scheduler(threadCount) {}
+
+CpuRenderer::~CpuRenderer() {
+    // Workers write into our buffers, which go before the scheduler does
+    stop();
+}
+
+double CpuRenderer::estimateCost(const CpuView& view, int x, int y) const {
+    if (lastCost.empty()) return 1.0;
+
+    // Pixel -> complex plane in the new view -> pixel in the previous one
+    double minRes = std::min(view.width, view.height);
+    double re = view.centerX + (x + 0.5 - 0.5 * view.width) / minRes * view.zoom;
+    double im = view.centerY + (y + 0.5 - 0.5 * view.height) / minRes * view.zoom;
+    double lastMinRes = std::min(lastView.width, lastView.height);
+    double lastX = (re - lastView.centerX) / lastView.zoom * lastMinRes + 0.5 * lastView.width;
+    double lastY = (im - lastView.centerY) / lastView.zoom * lastMinRes + 0.5 * lastView.height;
+
+    int tx = (int)std::floor(lastX / tileSize), ty = (int)std::floor(lastY / tileSize);
+    if (tx < 0 || ty < 0 || tx >= lastTilesX || ty >= lastTilesY) return lastMeanCost;
+    return lastCost[(size_t)ty * lastTilesX + tx];
+}
+
+void CpuRenderer::submit(const CpuView& view, Colorizer colorize, const std::atomic<uint64_t>& generation,
+                         uint8_t* target) {
+    jobView = view;
+    jobGenerationSource = &generation;
+    jobGeneration = generation.load();
+    resultTaken = false;
+
+    tilesX = (view.width + tileSize - 1) / tileSize;
+    tilesY = (view.height + tileSize - 1) / tileSize;
+    mu.resize((size_t)view.width * view.height);
+    if (!target) {
+        rgb.resize(mu.size() * 3);
+        target = rgb.data();
+    }
+    out = target;
+    count.resize(mu.size());
+    if (view.distanceEstimate) distance.resize(mu.size());
+    tileIterations.assign((size_t)tilesX * tilesY, 0);
+    tileMinDistance.assign(tileIterations.size(), 0.0f);
+    workerBins.resize(scheduler.threadCount());
+    for (auto& bins : workerBins) bins.assign(histogramBins, 0);
+    refineStarted = false;
+    {
+        std::lock_guard<std::mutex> lock(finishedMutex);
+        finished.clear();
+    }
+
+    // Rings of two tiles' width around the view center; what the user is
+    // looking at arrives first, and partial results are the useful ones
+    double centerX = 0.5 * view.width, centerY = 0.5 * view.height;
+    std::vector<Tile> tiles;
+    tiles.reserve(tileIterations.size());
+    for (int ty = 0; ty < tilesY; ty++) {
+        for (int tx = 0; tx < tilesX; tx++) {
+            Tile tile;
+            tile.x = tx * tileSize;
+            tile.y = ty * tileSize;
+            tile.width = std::min(tileSize, view.width - tile.x);
+            tile.height = std::min(tileSize, view.height - tile.y);
+            double midX = tile.x + 0.5 * tile.width, midY = tile.y + 0.5 * tile.height;
+            tile.priority = (int)(std::hypot(midX - centerX, midY - centerY) / (2 * tileSize));
+            tile.cost = estimateCost(view, (int)midX, (int)midY) * tile.width * tile.height;
+            tiles.push_back(tile);
+        }
+    }
+
+    auto work = [this, view, colorize](const Tile& tile, int worker) {
+        size_t first = (size_t)tile.y * view.width + tile.x;
+        uint64_t total = iterateBlock(view, tile.x, tile.y, tile.width, tile.height, view.width, &mu[first],
+                                      &count[first], view.distanceEstimate ? &distance[first] : nullptr);
+        float minDistance = INFINITY;
+        uint64_t* bins = workerBins[worker].data();
+        for (int y = tile.y; y < tile.y + tile.height; y++) {
+            size_t row = (size_t)y * view.width + tile.x;
+            for (int x = 0; x < tile.width; x++) {
+                if (mu[row + x] < (float)view.maxIterations) bins[histogramBin(mu[row + x], view.maxIterations)]++;
+            }
+            colorize(&mu[row], tile.width, view.maxIterations, view.zoom, &out[row * 3]);
+            if (view.distanceEstimate) {
+                shadeByDistance(&distance[row], tile.width, &out[row * 3]);
+                minDistance = std::min(minDistance, *std::min_element(&distance[row], &distance[row] + tile.width));
+            }
+        }
+        size_t index = (size_t)(tile.y / tileSize) * tilesX + tile.x / tileSize;
+        tileIterations[index] = total;
+        tileMinDistance[index] = minDistance;
+        std::lock_guard<std::mutex> lock(finishedMutex);
+        finished.push_back(tile);
+    };
+    const std::atomic<uint64_t>* source = &generation;
+    uint64_t submitted = jobGeneration;
+    scheduler.submit(std::move(tiles), work, [source, submitted] { return source->load() != submitted; });
+}
+
+void CpuRenderer::start(const CpuView& view, Colorizer colorize, const std::atomic<uint64_t>& generation,
+                        uint8_t* target) {
+    stop();
+    if (!resultTaken && !refineStarted && !scheduler.lastStats().cancelled) recordCosts();
+    submit(view, colorize, generation, target);
+}
+
+void CpuRenderer::stop() {
+    // A cancelled job drops its remaining tiles, so this waits for at most one tile per worker
+    scheduler.cancel();
+    scheduler.wait();
+}
+
+bool CpuRenderer::matches(const CpuView& view) const {
+    if (!jobGenerationSource || jobGenerationSource->load() != jobGeneration) return false;
+    return view.centerX == jobView.centerX && view.centerY == jobView.centerY
+        && view.zoom == jobView.zoom && view.width == jobView.width && view.height == jobView.height
+        && view.maxIterations == jobView.maxIterations && view.orbit == jobView.orbit
+        && view.distanceEstimate == jobView.distanceEstimate;
+}
+
+bool CpuRenderer::complete() {
+    return jobGenerationSource && scheduler.idle() && !scheduler.lastStats().cancelled;
+}
+
+void CpuRenderer::takeFinishedTiles(std::vector<Tile>& done) {
+    std::lock_guard<std::mutex> lock(finishedMutex);
+    done.insert(done.end(), finished.begin(), finished.end());
+    finished.clear();
+}
+
+bool CpuRenderer::takeResult(uint64_t& iterations, double& ms) {
+    if (resultTaken || !scheduler.idle() || scheduler.lastStats().cancelled) return false;
+    resultTaken = true;
+    if (!refineStarted) recordCosts();
+    iterations = 0;
+    for (uint64_t count : refineStarted ? refineIterations : tileIterations) iterations += count;
+    ms = scheduler.lastStats().wallMs;
+    return true;
+}
+
+void CpuRenderer::refine() {
+    scheduler.wait();
+    if (!resultTaken && !refineStarted && !scheduler.lastStats().cancelled) recordCosts();
+    refineStarted = true;
+    resultTaken = false;
+    // The per-tile lists keep their capacity from job to job
+    tileSubsamples.resize((size_t)tilesX * tilesY);
+    for (auto& subsamples : tileSubsamples) subsamples.clear();
+    refineIterations.assign(tileSubsamples.size(), 0);
+
+    // Edges are where the expensive tiles are, so their base cost orders the refinement too.
+    // With distance estimates, tiles that stay clear of the set are culled outright.
+    std::vector<Tile> tiles;
+    tiles.reserve(tileSubsamples.size());
+    for (int ty = 0; ty < tilesY; ty++) {
+        for (int tx = 0; tx < tilesX; tx++) {
+            if (jobView.distanceEstimate && tileMinDistance[(size_t)ty * tilesX + tx] > supersampleDistance) continue;
+            Tile tile;
+            tile.x = tx * tileSize;
+            tile.y = ty * tileSize;
+            tile.width = std::min(tileSize, jobView.width - tile.x);
+            tile.height = std::min(tileSize, jobView.height - tile.y);
+            tile.cost = (double)tileIterations[(size_t)ty * tilesX + tx];
+            tiles.push_back(tile);
+        }
+    }
+
+    auto work = [this, view = jobView](const Tile& tile, int) {
+        size_t index = (size_t)(tile.y / tileSize) * tilesX + tile.x / tileSize;
+        std::vector<Subsampled>& subsamples = tileSubsamples[index];
+        const float* distances = view.distanceEstimate ? distance.data() : nullptr;
+        uint64_t total = 0;
+        for (int y = tile.y; y < tile.y + tile.height; y++) {
+            for (int x = tile.x; x < tile.x + tile.width; x++) {
+                if (!needsSupersampling(mu.data(), distances, view.width, view.height, x, y)) continue;
+                Subsampled pixel;
+                pixel.pixel = (uint32_t)((size_t)y * view.width + x);
+                for (int k = 0; k < supersampleCount; k++) {
+                    float dx, dy;
+                    subsampleOffset(x, y, k, dx, dy);
+                    int iterations;
+                    pixel.mu[k] = getIterationsAt(view, (float)x + dx, (float)y + dy, iterations);
+                    total += iterations;
+                }
+                subsamples.push_back(pixel);
+            }
+        }
+        refineIterations[index] = total;
+    };
+    const std::atomic<uint64_t>* source = jobGenerationSource;
+    uint64_t submitted = jobGeneration;
+    scheduler.submit(std::move(tiles), work, [source, submitted] { return source->load() != submitted; });
+}
+
+void CpuRenderer::dropRefinement() {
+    refineStarted = false;
+}
+
+uint64_t CpuRenderer::render(const CpuView& view, Colorizer colorize, bool supersample) {
+    static const std::atomic<uint64_t> fixedGeneration{0};
+    scheduler.wait();
+    submit(view, colorize, fixedGeneration, nullptr);
+    scheduler.wait();
+    uint64_t iterations = 0;
+    double ms;
+    takeResult(iterations, ms);
+    if (supersample) {
+        uint64_t refineIterations;
+        refine();
+        scheduler.wait();
+        takeResult(refineIterations, ms);
+        recolor(colorize);
+    }
+    return iterations;
+}
+
+void CpuRenderer::forEachBand(const TileScheduler::Work& work) {
+    std::vector<Tile> bands;
+    for (int y = 0; y < jobView.height; y += tileSize) {
+        Tile band;
+        band.y = y;
+        band.width = jobView.width;
+        band.height = std::min(tileSize, jobView.height - y);
+        bands.push_back(band);
+    }
+    scheduler.run(bands, work);
+}
+
+void CpuRenderer::resolveSubsamples(int tileRow,
+                                    const std::function<void(const float* mu, size_t count, uint8_t* rgb)>& color) {
+    if (!refineStarted) return;
+    const int samples = supersampleCount + 1;
+    for (int tx = 0; tx < tilesX; tx++) {
+        for (const Subsampled& pixel : tileSubsamples[(size_t)tileRow * tilesX + tx]) {
+            float sampleMu[samples];
+            sampleMu[0] = mu[pixel.pixel];
+            std::copy(pixel.mu, pixel.mu + supersampleCount, sampleMu + 1);
+            uint8_t colors[samples * 3];
+            color(sampleMu, samples, colors);
+            for (int c = 0; c < 3; c++) {
+                int sum = 0;
+                for (int k = 0; k < samples; k++) sum += colors[k * 3 + c];
+                out[(size_t)pixel.pixel * 3 + c] = (uint8_t)((sum + samples / 2) / samples);
+            }
+        }
+    }
+}
+
+void CpuRenderer::recolor(Colorizer colorize) {
+    forEachBand([this, colorize](const Tile& band, int) {
+        size_t first = (size_t)band.y * band.width;
+        colorize(&mu[first], (size_t)band.width * band.height, jobView.maxIterations, jobView.zoom, &out[first * 3]);
+        resolveSubsamples(band.y / tileSize, [&](const float* samples, size_t count, uint8_t* colors) {
+            colorize(samples, count, jobView.maxIterations, jobView.zoom, colors);
+        });
+        if (jobView.distanceEstimate)
+            shadeByDistance(&distance[first], (size_t)band.width * band.height, &out[first * 3]);
+    });
+}
+
+void CpuRenderer::equalize(const Palette& palette) {
+    // The bins are tiny next to the frame, so the merge and scan stay serial
+    std::vector<uint64_t> bins(histogramBins, 0);
+    for (const auto& worker : workerBins) {
+        for (int i = 0; i < histogramBins; i++) bins[i] += worker[i];
+    }
+    cdf.resize(histogramBins);
+    buildCdf(bins.data(), cdf.data());
+    forEachBand([this, &palette](const Tile& band, int) {
+        size_t first = (size_t)band.y * band.width;
+        colorizeEqualized(palette, &mu[first], (size_t)band.width * band.height, jobView.maxIterations, cdf.data(),
+                          &out[first * 3]);
+        resolveSubsamples(band.y / tileSize, [&](const float* samples, size_t count, uint8_t* colors) {
+            colorizeEqualized(palette, samples, count, jobView.maxIterations, cdf.data(), colors);
+        });
+        if (jobView.distanceEstimate)
+            shadeByDistance(&distance[first], (size_t)band.width * band.height, &out[first * 3]);
+    });
+}
+
+void CpuRenderer::recordCosts() {
+    lastView = jobView;
+    lastView.orbit.reset();
+    lastTilesX = tilesX;
+    lastTilesY = tilesY;
+    lastCost.resize(tileIterations.size());
+    uint64_t frameTotal = 0;
+    for (int ty = 0; ty < tilesY; ty++) {
+        for (int tx = 0; tx < tilesX; tx++) {
+            size_t i = (size_t)ty * tilesX + tx;
+            int w = std::min(tileSize, jobView.width - tx * tileSize);
+            int h = std::min(tileSize, jobView.height - ty * tileSize);
+            lastCost[i] = (double)tileIterations[i] / (w * h);
+            frameTotal += tileIterations[i];
+        }
+    }
+    lastMeanCost = mu.empty() ? 0.0 : (double)frameTotal / mu.size();
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "colorize.h"
+#include "cpu_kernel.h"
+#include "supersample.h"
+#include "tile_scheduler.h"
+
+// Multi-threaded CPU engine: renders a view tile by tile on a TileScheduler and
+// colors each tile as soon as it is iterated. Tiles run from the center of the
+// view outward, most expensive first within each ring; costs measured in one
+// frame seed the ordering of the next. Each tile is one iterateBlock(), so
+// interior discs spare most of the set's interior.
+//
+// Jobs run in the background and are tagged with a generation number. Input
+// handlers bump the generation when the view changes, and the workers drop the
+// rest of a job as soon as its generation is out of date.
+//
+// A finished job keeps its smooth counts, so it can be recolored with another
+// palette, or histogram colored, without iterating again. It can also be
+// refined with extra samples along its edges, which the next recolor blends in.
+//
+// A job's RGB goes to pixels(), or to memory the caller hands start(), such as
+// a mapped pixel buffer the viewer uploads tiles from.
+class CpuRenderer {
+public:
+    explicit CpuRenderer(int threadCount = 0);
+    ~CpuRenderer();
+
+    // Starts rendering view in the background, first winding down any job
+    // still running. The job stays current while generation is unchanged. Its
+    // RGB goes to target, width * height * 3 bytes that stay valid until the
+    // next job, if given, and to pixels() otherwise.
+    void start(const CpuView& view, Colorizer colorize, const std::atomic<uint64_t>& generation,
+               uint8_t* target = nullptr);
+    // Drops the rest of the running job and waits for the tiles in flight
+    void stop();
+
+    // True if the running or finished job is for this view and still current
+    bool matches(const CpuView& view) const;
+    // True once the current job has run all of its tiles
+    bool complete();
+
+    // Moves the tiles finished since the last call into done; their pixels are
+    // complete in output() and are not touched again by this job
+    void takeFinishedTiles(std::vector<Tile>& done);
+
+    // Once per job, after its last tile: iterations performed and wall time.
+    // Once refined(), reports the refine pass instead.
+    bool takeResult(uint64_t& iterations, double& ms);
+
+    // Iterates jittered subsamples for the pixels of a complete job that sit
+    // on an edge (see supersample.h), in the background like start(). They
+    // show up in output() after the next recolor() or equalize().
+    void refine();
+    // True once refine() was started for the current job
+    bool refined() const { return refineStarted; }
+    // Forgets the subsamples, so recoloring goes back to one sample per pixel
+    void dropRefinement();
+
+    // Blocking render, not cancellable, optionally refined and recolored.
+    // Returns the total number of iterations of the base image.
+    uint64_t render(const CpuView& view, Colorizer colorize, bool supersample = false);
+
+    // Recolor every pixel of a complete job. These block, using all workers.
+    void recolor(Colorizer colorize);
+    // Histogram coloring from the counts the job's workers binned as they went
+    void equalize(const Palette& palette);
+
+    // Smooth counts and RGB8 (rows bottom-up) of the current job; pixels() is
+    // only written by jobs started without a target
+    const std::vector<float>& iterations() const { return mu; }
+    const std::vector<uint8_t>& pixels() const { return rgb; }
+    // Where the current job's RGB8 goes: its target, or pixels()
+    const uint8_t* output() const { return out; }
+    // Raw iteration count per pixel, for cost reports
+    const std::vector<uint32_t>& counts() const { return count; }
+    // Distance to the set per pixel, in pixels, when the view asks for distance estimation
+    const std::vector<float>& distances() const { return distance; }
+    TileScheduler::Stats schedulerStats() { return scheduler.lastStats(); }
+    int threadCount() const { return scheduler.threadCount(); }
+
+    static const int tileSize = 16;
+
+private:
+    // Iterations per pixel expected at (x, y) of the new view, looked up in the
+    // previous frame's tile costs
+    double estimateCost(const CpuView& view, int x, int y) const;
+    void submit(const CpuView& view, Colorizer colorize, const std::atomic<uint64_t>& generation, uint8_t* target);
+    // Keeps the finished job's tile costs for the next frame's estimates
+    void recordCosts();
+    // Runs work over horizontal bands of the job's rows
+    void forEachBand(const TileScheduler::Work& work);
+    // Replaces the pixels of a row of tiles that have subsamples by the average
+    // color of all their samples
+    void resolveSubsamples(int tileRow, const std::function<void(const float* mu, size_t count, uint8_t* rgb)>& color);
+
+    struct Subsampled {
+        uint32_t pixel;
+        float mu[supersampleCount];
+    };
+
+    TileScheduler scheduler;
+    std::vector<float> mu;
+    std::vector<uint8_t> rgb;
+    uint8_t* out = nullptr;  // the current job's RGB: rgb or its target
+    std::vector<uint32_t> count;
+    std::vector<float> distance;
+
+    // Current job
+    CpuView jobView;
+    const std::atomic<uint64_t>* jobGenerationSource = nullptr;
+    uint64_t jobGeneration = 0;
+    bool resultTaken = true;
+    int tilesX = 0, tilesY = 0;
+    std::vector<uint64_t> tileIterations;
+    std::vector<float> tileMinDistance;  // closest any pixel of the tile comes to the set
+    std::vector<std::vector<uint64_t>> workerBins;  // escaped pixels per histogram bin, per worker
+    std::vector<float> cdf;
+    bool refineStarted = false;
+    std::vector<std::vector<Subsampled>> tileSubsamples;
+    std::vector<uint64_t> refineIterations;  // per tile
+    std::mutex finishedMutex;
+    std::vector<Tile> finished;
+
+    // Last completed job, for cost estimates
+    CpuView lastView;
+    int lastTilesX = 0, lastTilesY = 0;
+    std::vector<double> lastCost;  // iterations per pixel, per tile
+    double lastMeanCost = 0.0;
+};
@@ -0,0 +1,156 @@
+#include "frame_capture.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include "image_io.h"
+#include "trace.h"
+
+FrameCapture::~FrameCapture() {
+    // The GL objects are gone with the context by now; only the threads need stopping
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    ready.notify_all();
+    for (std::thread& encoder : encoders) encoder.join();
+}
+
+void FrameCapture::init(int encoderThreads) {
+    for (Readback& readback : ring) glGenBuffers(1, &readback.buffer);
+    for (int i = 0; i < encoderThreads; i++) encoders.emplace_back(&FrameCapture::encodeLoop, this, i);
+}
+
+void FrameCapture::destroy() {
+    flush();
+    for (Readback& readback : ring) {
+        glDeleteBuffers(1, &readback.buffer);
+        readback = Readback();
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    ready.notify_all();
+    for (std::thread& encoder : encoders) encoder.join();
+    encoders.clear();
+}
+
+void FrameCapture::capture(int width, int height, const std::string& path, int level) {
+    TRACE_SCOPE("capture");
+    Readback& readback = ring[next];
+    next = (next + 1) % ringSize;
+    // Only once the ring wraps around onto a readback still in flight
+    collect(readback, true);
+
+    size_t size = (size_t)width * height * 3;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+    if (size > readback.size) {
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+        readback.size = size;
+    }
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    readback.width = width;
+    readback.height = height;
+    readback.path = path;
+    readback.sequence = nullptr;
+    readback.level = level;
+}
+
+void FrameCapture::capture(int width, int height, const std::shared_ptr<CaptureSequence>& sequence, int level) {
+    capture(width, height, std::string(), level);
+    ring[(next + ringSize - 1) % ringSize].sequence = sequence;
+}
+
+void FrameCapture::poll() {
+    // Oldest first, so frames reach the encoders in order
+    for (int i = 0; i < ringSize; i++) collect(ring[(next + i) % ringSize], false);
+}
+
+void FrameCapture::flush() {
+    for (int i = 0; i < ringSize; i++) collect(ring[(next + i) % ringSize], true);
+}
+
+void FrameCapture::collect(Readback& readback, bool wait) {
+    if (!readback.fence) return;
+    GLenum status = glClientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    if (wait) {
+        TRACE_SCOPE("waitReadback");
+        while (status == GL_TIMEOUT_EXPIRED)
+            status = glClientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 100000000);
+    }
+    if (status == GL_TIMEOUT_EXPIRED) return;
+    glDeleteSync(readback.fence);
+    readback.fence = 0;
+
+    std::shared_ptr<CaptureSequence> sequence = std::move(readback.sequence);
+    readback.sequence = nullptr;
+    Encode encode;
+    encode.width = readback.width;
+    encode.height = readback.height;
+    encode.path = readback.path;
+    encode.level = readback.level;
+    size_t size = (size_t)readback.width * readback.height * 3;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (queuedBytes + size > maxQueuedBytes) {
+            if (sequence) sequence->dropped++;
+            else droppedFrames++;
+            return;
+        }
+        queuedBytes += size;
+    }
+    encode.rgb.resize(size);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+    const void* pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+    if (pixels) {
+        std::memcpy(encode.rgb.data(), pixels, size);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    } else {
+        std::cerr << "Failed to map the readback of " << (sequence ? sequence->directory : readback.path) << std::endl;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (pixels && sequence) {
+        char name[32];
+        std::snprintf(name, sizeof(name), "frame-%06ld.png", sequence->written++);
+        encode.path = sequence->directory + "/" + name;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!pixels) {
+        if (sequence) sequence->dropped++;
+        queuedBytes -= size;
+        return;
+    }
+    queue.push_back(std::move(encode));
+    ready.notify_one();
+}
+
+void FrameCapture::encodeLoop(int id) {
+    traceThreadName("encoder " + std::to_string(id));
+    for (;;) {
+        Encode encode;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            ready.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (queue.empty()) return;
+            encode = std::move(queue.front());
+            queue.pop_front();
+        }
+        std::vector<uint8_t> png;
+        {
+            TRACE_SCOPE("encodePng");
+            if (encodePng(encode.width, encode.height, encode.rgb.data(), png, encode.level)) {
+                std::ofstream out(encode.path, std::ios::binary);
+                out.write((const char*)png.data(), png.size());
+                if (!out) std::cerr << "Failed to write " << encode.path << std::endl;
+            }
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        queuedBytes -= encode.rgb.size();
+    }
+}
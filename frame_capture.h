@@ -0,0 +1,88 @@
+#pragma once
+
+#include "gl_includes.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Saves what the viewer shows as PNG files without stalling the frame.
+// capture() reads the bound read framebuffer into a pixel buffer object and
+// fences it; poll() collects readbacks the GPU has finished, a frame or two
+// later, and hands them to encoder threads that deflate and write them. At 60
+// fps a recording keeps a few readbacks in flight and the encoders a few
+// frames behind, so the render loop only waits if the ring of buffers wraps
+// around onto a readback the GPU has not finished yet.
+
+// A recording: frame-000000.png, frame-000001.png, ... in directory. A frame
+// gets its number when it goes to the encoders, so frames dropped because the
+// encoders fell behind leave no gap for tools reading the sequence.
+struct CaptureSequence {
+    std::string directory;
+    long written = 0;  // frames handed to the encoders
+    long dropped = 0;
+};
+
+class FrameCapture {
+public:
+    ~FrameCapture();
+
+    void init(int encoderThreads = 2);
+    // Finishes every capture, then frees the buffers and stops the encoders
+    void destroy();
+
+    // Queues the bottom-left width x height of the read framebuffer, to be
+    // written to path as a PNG deflated at level
+    void capture(int width, int height, const std::string& path, int level = 6);
+    // Queues the next frame of sequence
+    void capture(int width, int height, const std::shared_ptr<CaptureSequence>& sequence, int level = 6);
+    // Moves finished readbacks to the encoders; once a frame
+    void poll();
+    // Waits for every readback in flight and moves it to the encoders, which
+    // makes the counts of a sequence that gets no more frames final
+    void flush();
+
+    // Single captures the encoders dropped because they fell too far behind;
+    // sequences count their own
+    long dropped() const { return droppedFrames; }
+
+private:
+    struct Readback {
+        GLuint buffer = 0;
+        size_t size = 0;  // allocated bytes
+        GLsync fence = 0;
+        int width = 0, height = 0;
+        std::string path;  // unless sequence names it
+        std::shared_ptr<CaptureSequence> sequence;
+        int level = 6;
+    };
+    struct Encode {
+        int width = 0, height = 0;
+        std::string path;
+        int level = 6;
+        std::vector<uint8_t> rgb;
+    };
+
+    // Maps a fenced readback, waiting for the GPU if it has to, and queues it
+    void collect(Readback& readback, bool wait);
+    void encodeLoop(int id);
+
+    static const int ringSize = 4;
+    // Encodes waiting past this many bytes of pixels are dropped
+    static const size_t maxQueuedBytes = (size_t)256 << 20;
+    Readback ring[ringSize];
+    int next = 0;
+
+    std::vector<std::thread> encoders;
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<Encode> queue;
+    size_t queuedBytes = 0;
+    bool stopping = false;
+    long droppedFrames = 0;
+};
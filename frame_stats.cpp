@@ -0,0 +1,211 @@
+#include "frame_stats.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+namespace {
+
+const char* stageNames[StageCount] = {"iterate", "histogram", "supersample", "colorize", "accumulate", "blit", "realloc"};
+
+// Bar colors per stage
+const float stageColors[StageCount][3] = {
+    {0.95f, 0.45f, 0.10f},
+    {0.95f, 0.85f, 0.20f},
+    {0.60f, 0.40f, 0.95f},
+    {0.20f, 0.70f, 0.95f},
+    {0.10f, 0.45f, 0.60f},
+    {0.40f, 0.90f, 0.30f},
+    {0.90f, 0.20f, 0.60f},
+};
+
+const double frameBudgetMs = 1000.0 / 60.0;
+
+} // namespace
+
+double FrameStats::totalMs() const {
+    double total = 0.0;
+    for (double ms : stageMs) total += ms;
+    return total;
+}
+
+double FrameStats::mpixelsPerSecond() const {
+    double ms = stageMs[StageIterate] + stageMs[StageColorize];
+    if (ms <= 0.0) return 0.0;
+    return (double)renderWidth * renderHeight / (ms * 1e3);
+}
+
+double FrameStats::giterationsPerSecond() const {
+    double ms = stageMs[StageIterate];
+    if (!hasIterations || ms <= 0.0) return 0.0;
+    return (double)iterations / (ms * 1e6);
+}
+
+void FrameTimer::init() {
+    for (Slot& slot : slots) {
+        glGenQueries(StageCount, slot.queries);
+        glGenBuffers(1, &slot.iterationBuffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, slot.iterationBuffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, 2 * sizeof(GLuint), NULL, GL_STREAM_READ);
+    }
+}
+
+void FrameTimer::destroy() {
+    for (Slot& slot : slots) {
+        glDeleteQueries(StageCount, slot.queries);
+        glDeleteBuffers(1, &slot.iterationBuffer);
+    }
+}
+
+void FrameTimer::beginFrame(int renderWidth, int renderHeight) {
+    int next = (current + 1) % ringSize;
+    // The GPU is a full ring behind; skip timing this frame rather than wait for it
+    if (slots[next].pending) {
+        current = -1;
+        return;
+    }
+    current = next;
+    Slot& slot = slots[current];
+    slot.stats = FrameStats();
+    slot.stats.frame = frameCount++;
+    slot.stats.renderWidth = renderWidth;
+    slot.stats.renderHeight = renderHeight;
+    for (bool& used : slot.used) used = false;
+    slot.gpuIterations = false;
+}
+
+void FrameTimer::begin(FrameStage stage) {
+    if (current < 0) return;
+    glBeginQuery(GL_TIME_ELAPSED, slots[current].queries[stage]);
+    slots[current].used[stage] = true;
+    activeStage = stage;
+}
+
+void FrameTimer::end() {
+    if (current < 0 || activeStage == StageCount) return;
+    glEndQuery(GL_TIME_ELAPSED);
+    activeStage = StageCount;
+}
+
+void FrameTimer::recordIterations(GLuint buffer, GLintptr offset) {
+    if (current < 0) return;
+    glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, slots[current].iterationBuffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offset, 0, 2 * sizeof(GLuint));
+    slots[current].stats.hasIterations = true;
+    slots[current].gpuIterations = true;
+}
+
+void FrameTimer::recordCpuStage(FrameStage stage, double ms) {
+    if (current < 0) return;
+    slots[current].stats.stageMs[stage] = ms;
+}
+
+void FrameTimer::recordIterations(uint64_t iterations) {
+    if (current < 0) return;
+    slots[current].stats.hasIterations = true;
+    slots[current].stats.iterations = iterations;
+}
+
+void FrameTimer::endFrame() {
+    if (current < 0) return;
+    slots[current].pending = true;
+}
+
+bool FrameTimer::poll(FrameStats& stats) {
+    Slot& slot = slots[oldest];
+    if (!slot.pending) return false;
+
+    // Stages are not issued in index order (realloc comes first), so ask every
+    // query; reading a result that is not available yet would stall. The
+    // iteration copy is issued before the frame's blit, so it is done by now too.
+    for (int stage = 0; stage < StageCount; stage++) {
+        if (!slot.used[stage]) continue;
+        GLuint available = 0;
+        glGetQueryObjectuiv(slot.queries[stage], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) return false;
+    }
+
+    for (int stage = 0; stage < StageCount; stage++) {
+        if (!slot.used[stage]) continue;
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(slot.queries[stage], GL_QUERY_RESULT, &ns);
+        slot.stats.stageMs[stage] = ns * 1e-6;
+    }
+    if (slot.gpuIterations) {
+        GLuint counts[2] = {0, 0};
+        glBindBuffer(GL_COPY_READ_BUFFER, slot.iterationBuffer);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(counts), counts);
+        slot.stats.iterations = ((uint64_t)counts[1] << 32) | counts[0];
+    }
+
+    stats = slot.stats;
+    slot.pending = false;
+    oldest = (oldest + 1) % ringSize;
+    return true;
+}
+
+bool StatsLog::open(const std::string& path) {
+    out.open(path, std::ios::trunc);
+    if (!out) {
+        std::cerr << "Cannot open stats log " << path << std::endl;
+        return false;
+    }
+    out << "frame,render_width,render_height";
+    for (const char* name : stageNames) out << "," << name << "_ms";
+    out << ",mpixel_per_s,iterations,giter_per_s\n";
+    return true;
+}
+
+void StatsLog::write(const FrameStats& stats) {
+    if (!out.is_open()) return;
+    out << stats.frame << "," << stats.renderWidth << "," << stats.renderHeight;
+    for (double ms : stats.stageMs) out << "," << ms;
+    out << "," << stats.mpixelsPerSecond() << ",";
+    if (stats.hasIterations) out << stats.iterations << "," << stats.giterationsPerSecond();
+    else out << ",";
+    out << "\n";
+}
+
+void drawTimingHud(const FrameStats& stats, int fbWidth, int fbHeight) {
+    const int margin = 8, barHeight = 12;
+    const double pixelsPerMs = 300.0 / frameBudgetMs;
+    int top = fbHeight - margin - barHeight;
+
+    glEnable(GL_SCISSOR_TEST);
+    // Backdrop up to twice the budget, then each stage laid end to end
+    glScissor(margin - 2, top - 2, (int)(2 * frameBudgetMs * pixelsPerMs) + 4, barHeight + 4);
+    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    int x = margin;
+    for (int stage = 0; stage < StageCount; stage++) {
+        int w = (int)(stats.stageMs[stage] * pixelsPerMs + 0.5);
+        w = std::min(w, fbWidth - x - margin);
+        if (w <= 0) continue;
+        glScissor(x, top, w, barHeight);
+        glClearColor(stageColors[stage][0], stageColors[stage][1], stageColors[stage][2], 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        x += w;
+    }
+
+    glScissor(margin + (int)(frameBudgetMs * pixelsPerMs), top - 2, 2, barHeight + 4);
+    glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    glDisable(GL_SCISSOR_TEST);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+}
+
+std::string formatStats(const FrameStats& stats) {
+    char text[256];
+    int n = std::snprintf(text, sizeof(text), "%dx%d", stats.renderWidth, stats.renderHeight);
+    for (int stage = 0; stage < StageCount; stage++) {
+        n += std::snprintf(text + n, sizeof(text) - n, " | %s %.2f ms", stageNames[stage], stats.stageMs[stage]);
+    }
+    n += std::snprintf(text + n, sizeof(text) - n, " | %.1f Mpix/s", stats.mpixelsPerSecond());
+    if (stats.hasIterations) {
+        std::snprintf(text + n, sizeof(text) - n, " | %.2f Giter/s", stats.giterationsPerSecond());
+    }
+    return text;
+}
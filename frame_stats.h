@@ -0,0 +1,83 @@
+#pragma once
+
+#include "gl_includes.h"
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+enum FrameStage {
+    StageIterate,
+    StageHistogram,
+    StageSupersample,
+    StageColorize,
+    StageAccumulate,
+    StageBlit,
+    StageRealloc,
+    StageCount
+};
+
+struct FrameStats {
+    long frame = -1;
+    int renderWidth = 0, renderHeight = 0;
+    double stageMs[StageCount] = {};
+    bool hasIterations = false;
+    uint64_t iterations = 0;
+
+    double totalMs() const;
+    double mpixelsPerSecond() const;
+    double giterationsPerSecond() const;
+};
+
+// GPU stage timing with GL_TIME_ELAPSED queries. Results are collected a few
+// frames later, once the GPU reports them available, so the CPU never waits.
+class FrameTimer {
+public:
+    void init();
+    void destroy();
+
+    void beginFrame(int renderWidth, int renderHeight);
+    void begin(FrameStage stage);
+    void end();
+    // Copies a 64-bit iteration total (two uints: low, high) out of a GPU buffer
+    void recordIterations(GLuint buffer, GLintptr offset);
+    // Stages done on the CPU report their time and iterations directly
+    void recordCpuStage(FrameStage stage, double ms);
+    void recordIterations(uint64_t iterations);
+    void endFrame();
+
+    // Returns the oldest finished frame, if any, without stalling
+    bool poll(FrameStats& stats);
+
+private:
+    static const int ringSize = 4;
+    struct Slot {
+        GLuint queries[StageCount] = {};
+        bool used[StageCount] = {};
+        GLuint iterationBuffer = 0;
+        bool gpuIterations = false;  // iteration total still sits in iterationBuffer
+        bool pending = false;
+        FrameStats stats;
+    };
+    Slot slots[ringSize];
+    int current = -1;
+    int oldest = 0;
+    long frameCount = 0;
+    FrameStage activeStage = StageCount;
+};
+
+// CSV log of per-frame stats, one row per timed frame
+class StatsLog {
+public:
+    bool open(const std::string& path);
+    void write(const FrameStats& stats);
+    bool isOpen() const { return out.is_open(); }
+
+private:
+    std::ofstream out;
+};
+
+// Stacked per-stage bar in the top-left corner, with a tick at the 60 Hz budget
+void drawTimingHud(const FrameStats& stats, int fbWidth, int fbHeight);
+
+std::string formatStats(const FrameStats& stats);
@@ -0,0 +1,20 @@
+#pragma once
+
+#define GL_SILENCE_DEPRECATION
+#ifdef __APPLE__
+#include <OpenGL/gl3.h>
+#else
+#define GL_GLEXT_PROTOTYPES
+#include <GL/glcorearb.h>
+#endif
+
+// The compute path needs GL 4.3, which macOS does not provide
+#ifdef GL_COMPUTE_SHADER
+#define MANDEL_HAVE_COMPUTE 1
+#endif
+
+// Persistently mapped buffers need GL 4.4 or ARB_buffer_storage, which the
+// context is asked for at run time
+#ifdef GL_MAP_PERSISTENT_BIT
+#define MANDEL_HAVE_BUFFER_STORAGE 1
+#endif
@@ -0,0 +1,356 @@
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+#include "gl_renderer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+// GLFW is initialized while any renderer's window exists
+int liveWindows = 0;
+
+// Tiles a persistent compute group takes where the driver doesn't limit loops
+const GLuint defaultTilesPerGroup = 16;
+// llvmpipe ends an outermost shader loop after this many iterations, counting
+// those of the loops inside it, with some left for the tile loop itself
+const int driverLoopBudget = 60000;
+
+} // namespace
+
+void ComputePasses::init() {
+#ifdef MANDEL_HAVE_COMPUTE
+    const GLubyte* renderer = glGetString(GL_RENDERER);
+    loopBudget = renderer && std::strstr((const char*)renderer, "llvmpipe");
+    glGenBuffers(1, &iterationBuffer);
+    glGenBuffers(1, &counterBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, counterBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, 3 * sizeof(GLuint), NULL, GL_DYNAMIC_DRAW);
+    glGenBuffers(1, &refineListBuffer);
+    glGenBuffers(1, &refineSlotBuffer);
+    glGenBuffers(1, &subsampleBuffer);
+    glGenBuffers(1, &distanceBuffer);
+
+    // The scan pass clears the bins after reading them, so they start at zero only once
+    std::vector<GLuint> zeroBins(histogramBins, 0);
+    glGenBuffers(1, &histogramBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, histogramBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, zeroBins.size() * sizeof(GLuint), zeroBins.data(), GL_DYNAMIC_COPY);
+    glGenBuffers(1, &cdfBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, cdfBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, histogramBins * sizeof(float), NULL, GL_DYNAMIC_COPY);
+#endif
+}
+
+void ComputePasses::destroy() {
+#ifdef MANDEL_HAVE_COMPUTE
+    computePrograms.destroy();
+    histogramPrograms.destroy();
+    scanPrograms.destroy();
+    refineFlagPrograms.destroy();
+    refinePrograms.destroy();
+#endif
+    GLuint buffers[] = {iterationBuffer, counterBuffer, histogramBuffer, cdfBuffer,
+                        refineListBuffer, refineSlotBuffer, subsampleBuffer, distanceBuffer};
+    glDeleteBuffers(8, buffers);
+}
+
+void ComputePasses::resize(int newWidth, int newHeight) {
+#ifdef MANDEL_HAVE_COMPUTE
+    width = newWidth;
+    height = newHeight;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, iterationBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)width * height * sizeof(float), NULL, GL_DYNAMIC_COPY);
+
+    // Room for subsamples of a quarter of the pixels; edges past that stay unrefined
+    GLsizeiptr capacity = std::max(1, width * height / 4);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, refineListBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (4 + capacity) * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, refineSlotBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)width * height * sizeof(GLint), NULL, GL_DYNAMIC_COPY);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, subsampleBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, capacity * supersampleCount * sizeof(float), NULL, GL_DYNAMIC_COPY);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, distanceBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)width * height * sizeof(float), NULL, GL_DYNAMIC_COPY);
+#endif
+}
+
+void ComputePasses::iterate(bool perturb, bool distance, int maxIterations) {
+#ifdef MANDEL_HAVE_COMPUTE
+    GLuint zeros[3] = {0, 0, 0};  // the iteration total and the tile queue
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, counterBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zeros), zeros);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, iterationBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, counterBuffer);
+    GLuint program = computePrograms.get({false, perturb, false, false, distance});
+    glUseProgram(program);
+
+    // Under llvmpipe's loop budget a group takes only the tiles whose slowest
+    // pixels fit in it, and one at a time for the deepest views
+    GLuint tilesPerGroup = defaultTilesPerGroup;
+    if (loopBudget) tilesPerGroup = (GLuint)std::max(1, driverLoopBudget / (maxIterations + 1));
+    tilesPerGroup = std::min(tilesPerGroup, defaultTilesPerGroup);
+    glUniform1ui(glGetUniformLocation(program, "u_tilesPerGroup"), tilesPerGroup);
+    GLuint tiles = (GLuint)((width + 7) / 8) * (GLuint)((height + 7) / 8);
+    GLuint groups = (tiles + tilesPerGroup - 1) / tilesPerGroup;
+    // Spread over two dimensions past the 65535 groups a dimension is sure to
+    // hold; the spare groups find the queue empty
+    GLuint groupsX = std::min(groups, 65535u);
+    glDispatchCompute(groupsX, (groups + groupsX - 1) / groupsX, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+#endif
+}
+
+void ComputePasses::histogram() {
+#ifdef MANDEL_HAVE_COMPUTE
+    glUseProgram(histogramPrograms.get({}));
+    GLuint groups = std::min(64, (width * height + 255) / 256);
+    glDispatchCompute(groups, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    glUseProgram(scanPrograms.get({}));
+    glDispatchCompute(1, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+#endif
+}
+
+void ComputePasses::refine(bool perturb, bool distance) {
+#ifdef MANDEL_HAVE_COMPUTE
+    GLuint header[4] = {0, 1, 1, 0};  // groups x, y, z and the pixel count
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, refineListBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(header), header);
+    glUseProgram(refineFlagPrograms.get({false, false, false, false, distance}));
+    glDispatchCompute((width + 7) / 8, (height + 7) / 8, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+    glUseProgram(refinePrograms.get({false, perturb}));
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, refineListBuffer);
+    glDispatchComputeIndirect(0);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+#endif
+}
+
+uint64_t ComputePasses::readIterations() {
+    GLuint counts[2] = {0, 0};
+#ifdef MANDEL_HAVE_COMPUTE
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, counterBuffer);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(counts), counts);
+#endif
+    return ((uint64_t)counts[1] << 32) | counts[0];
+}
+
+void ComputePasses::readCounts(std::vector<float>& mu) {
+#ifdef MANDEL_HAVE_COMPUTE
+    mu.resize((size_t)width * height);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, iterationBuffer);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, mu.size() * sizeof(float), mu.data());
+#endif
+}
+
+GlRenderer::GlRenderer(std::vector<Palette> palettes) : palettes(std::move(palettes)) {}
+
+bool GlRenderer::init(int initialWidth, int initialHeight) {
+    if (window || palettes.empty() || !glfwInit()) return false;
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#ifdef MANDEL_HAVE_COMPUTE
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    window = glfwCreateWindow(initialWidth, initialHeight, "mandel", NULL, NULL);
+    computeSupported = window != NULL;
+#endif
+    if (!window) {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+        window = glfwCreateWindow(initialWidth, initialHeight, "mandel", NULL, NULL);
+    }
+    glfwDefaultWindowHints();
+    if (!window) {
+        if (liveWindows == 0) glfwTerminate();
+        return false;
+    }
+    liveWindows++;
+    glfwMakeContextCurrent(window);
+
+    float vertices[] = {-1.0f, 1.0f, -1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, -1.0f, 1.0f, 1.0f};
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &vbo);
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+
+    glGenBuffers(1, &viewStateBuffer);
+    glBindBufferBase(GL_UNIFORM_BUFFER, viewStateBinding, viewStateBuffer);
+    glGenFramebuffers(1, &fbo);
+    glGenTextures(1, &fboTexture);
+    glGenFramebuffers(1, &iterationFbo);
+    glGenTextures(1, &iterationTexture);
+    glGenBuffers(1, &orbitBuffer);
+    glGenTextures(1, &orbitTexture);
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxOrbitLength);
+    usePalette(0);
+
+    if (computeSupported) passes.init();
+    allocate(initialWidth, initialHeight);
+    return true;
+}
+
+GlRenderer::~GlRenderer() {
+    if (!window) return;
+    glfwMakeContextCurrent(window);
+    fragmentPrograms.destroy();
+    iterationPrograms.destroy();
+    colorizePrograms.destroy();
+    passes.destroy();
+    glDeleteVertexArrays(1, &vao);
+    glDeleteBuffers(1, &vbo);
+    glDeleteBuffers(1, &viewStateBuffer);
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteTextures(1, &fboTexture);
+    glDeleteFramebuffers(1, &iterationFbo);
+    glDeleteTextures(1, &iterationTexture);
+    glDeleteTextures(1, &orbitTexture);
+    glDeleteBuffers(1, &orbitBuffer);
+    glDeleteTextures(1, &paletteTexture);
+    glfwMakeContextCurrent(NULL);
+    glfwDestroyWindow(window);
+    if (--liveWindows == 0) glfwTerminate();
+}
+
+std::string GlRenderer::deviceName() const {
+    const GLubyte* name = glGetString(GL_RENDERER);
+    return name ? (const char*)name : "unknown";
+}
+
+void GlRenderer::allocate(int newWidth, int newHeight) {
+    width = newWidth;
+    height = newHeight;
+    glBindTexture(GL_TEXTURE_2D, fboTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, fboTexture, 0);
+
+    glBindTexture(GL_TEXTURE_2D, iterationTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, width, height, 0, GL_RED, GL_FLOAT, NULL);
+    glBindFramebuffer(GL_FRAMEBUFFER, iterationFbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, iterationTexture, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(0, 0, width, height);
+
+    if (computeSupported) passes.resize(width, height);
+}
+
+void GlRenderer::usePalette(int index) {
+    if (index == uploadedPalette) return;
+    glActiveTexture(GL_TEXTURE0 + paletteTextureUnit);
+    glDeleteTextures(1, &paletteTexture);
+    paletteTexture = createPaletteTexture(palettes[index]);
+    glActiveTexture(GL_TEXTURE0);
+    uploadedPalette = index;
+}
+
+void GlRenderer::prepare(const CpuView& view) {
+    glfwMakeContextCurrent(window);
+    ViewStateBlock block = {};
+    block.center[0] = view.centerX;
+    block.center[1] = view.centerY;
+    block.zoom = view.zoom;
+    block.resolution[0] = (float)width;
+    block.resolution[1] = (float)height;
+    block.maxIterations = view.maxIterations;
+    maxIterations = view.maxIterations;
+    perturb = view.orbit != nullptr;
+    if (perturb) {
+        GLint orbitLength = std::min(view.orbit->length(), (int)maxOrbitLength);
+        glBindBuffer(GL_TEXTURE_BUFFER, orbitBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, orbitLength * 2 * sizeof(double), view.orbit->z.data(), GL_STATIC_DRAW);
+        glActiveTexture(GL_TEXTURE0 + orbitTextureUnit);
+        glBindTexture(GL_TEXTURE_BUFFER, orbitTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32UI, orbitBuffer);
+        glActiveTexture(GL_TEXTURE0);
+        block.refOffset[0] = view.centerX - view.orbit->centerX;
+        block.refOffset[1] = view.centerY - view.orbit->centerY;
+        block.orbitLength = orbitLength;
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, viewStateBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(block), &block, GL_STATIC_DRAW);
+    glFinish();
+}
+
+void GlRenderer::draw(ProgramVariants& programs, const VariantKey& key) {
+    glUseProgram(programs.get(key));
+    glBindVertexArray(vao);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+}
+
+void GlRenderer::renderFragment(bool distance) {
+    draw(fragmentPrograms, {true, perturb, false, false, distance});
+    glFinish();
+}
+
+void GlRenderer::renderCompute(bool supersample, bool distance) {
+    if (!computeSupported) return;
+    passes.iterate(perturb, distance, maxIterations);
+    if (supersample) passes.refine(perturb, distance);
+    draw(colorizePrograms, {true, perturb, false, supersample, distance});
+    glFinish();
+}
+
+void GlRenderer::fragmentIterations(std::vector<float>& mu) {
+    glBindFramebuffer(GL_FRAMEBUFFER, iterationFbo);
+    draw(iterationPrograms, {false, perturb});
+    mu.resize((size_t)width * height);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glReadPixels(0, 0, width, height, GL_RED, GL_FLOAT, mu.data());
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+}
+
+bool GlRenderer::render(const ViewParams& view, RenderResult& result) {
+    if (view.palette < 0 || view.palette >= (int)palettes.size()) {
+        std::cerr << "No palette " << view.palette + 1 << std::endl;
+        return false;
+    }
+    if ((view.histogram || view.supersample) && !computeSupported) {
+        std::cerr << "Histogram coloring and supersampling need the compute path" << std::endl;
+        return false;
+    }
+    if (view.colorZoom > 0.0 && view.colorZoom != view.zoom) {
+        std::cerr << "The shaders enhance contrast for the view's own zoom only" << std::endl;
+        return false;
+    }
+    if (view.width <= 0 || view.height <= 0) {
+        std::cerr << "Invalid render size " << view.width << "x" << view.height << std::endl;
+        return false;
+    }
+
+    glfwMakeContextCurrent(window);
+    if (view.width != width || view.height != height) allocate(view.width, view.height);
+    std::shared_ptr<const ReferenceOrbit> orbit;
+    if (view.perturbed()) orbit = orbits.get(view.centerX, view.centerY, view.zoom, view.maxIterations);
+    prepare(cpuView(view, orbit));
+    usePalette(view.palette);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(0, 0, width, height);
+    result.width = width;
+    result.height = height;
+    result.iterations = 0;
+    result.mu.clear();
+    if (computeSupported) {
+        passes.iterate(perturb, view.distanceEstimate, view.maxIterations);
+        if (view.histogram) passes.histogram();
+        if (view.supersample) passes.refine(perturb, view.distanceEstimate);
+        draw(colorizePrograms,
+             {view.contrastEnhance, perturb, view.histogram, view.supersample, view.distanceEstimate});
+        result.iterations = passes.readIterations();
+        passes.readCounts(result.mu);
+    } else {
+        draw(fragmentPrograms, {view.contrastEnhance, perturb, false, false, view.distanceEstimate});
+    }
+
+    result.rgb.resize((size_t)width * height * 3);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, result.rgb.data());
+    return true;
+}
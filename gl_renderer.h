@@ -0,0 +1,114 @@
+#pragma once
+
+#include "gl_includes.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "cpu_kernel.h"
+#include "orbit.h"
+#include "renderer.h"
+#include "shaders.h"
+
+struct GLFWwindow;
+
+// The compute path's passes and the buffers they work in, for whichever
+// context is current. GlRenderer renders with one, and the viewer runs its
+// own in its window's context, timing each pass. The buffers stay bound to
+// the storage bindings the colorize shaders read. Only for contexts with
+// compute shaders; without MANDEL_HAVE_COMPUTE the passes do nothing.
+class ComputePasses {
+public:
+    void init();
+    void destroy();
+    // Sizes the buffers for width x height renders
+    void resize(int newWidth, int newHeight);
+
+    // Smooth counts of the current view state, whose iteration limit is
+    // maxIterations, into the iteration buffer, and the iterations spent into
+    // counters()
+    void iterate(bool perturb, bool distance, int maxIterations);
+    // The CDF of the iteration buffer, for histogram coloring
+    void histogram();
+    // Extra samples for the pixels on edges in the iteration buffer
+    void refine(bool perturb, bool distance);
+
+    // The low and high word of the iterations of the last iterate() lead it
+    GLuint counters() const { return counterBuffer; }
+    uint64_t readIterations();
+    void readCounts(std::vector<float>& mu);
+
+private:
+    int width = 0, height = 0;
+    bool loopBudget = false;  // the driver ends long shader loops (llvmpipe)
+    GLuint iterationBuffer = 0, counterBuffer = 0, histogramBuffer = 0, cdfBuffer = 0;
+    GLuint refineListBuffer = 0, refineSlotBuffer = 0, subsampleBuffer = 0, distanceBuffer = 0;
+#ifdef MANDEL_HAVE_COMPUTE
+    ProgramVariants computePrograms{buildComputeProgram};
+    ProgramVariants histogramPrograms{buildHistogramProgram};
+    ProgramVariants scanPrograms{buildScanProgram};
+    ProgramVariants refineFlagPrograms{buildRefineFlagProgram};
+    ProgramVariants refinePrograms{buildRefineProgram};
+#endif
+};
+
+// The viewer's shader paths rendering offscreen, in a hidden window with a GL
+// context of its own. render() uses the compute path where the context has
+// one and the fragment path otherwise; histogram coloring and supersampling
+// need the compute path, and a colorZoom other than the view's is CPU only.
+//
+// GLFW creates windows on the main thread only, so create instances there;
+// each one then renders on whichever thread calls it, one thread at a time.
+class GlRenderer : public Renderer {
+public:
+    explicit GlRenderer(std::vector<Palette> palettes);
+    ~GlRenderer() override;
+
+    // Creates the context and the targets for width x height renders, which
+    // render() resizes as views need. False if there is no GL 4.1 context.
+    bool init(int width, int height);
+
+    bool render(const ViewParams& view, RenderResult& result) override;
+    std::string name() const override { return "gl"; }
+
+    bool hasCompute() const { return computeSupported; }
+    // GL_RENDERER of the context
+    std::string deviceName() const;
+
+    // The steps of render(), for timing the draws alone. prepare() makes the
+    // context current, uploads the view state and orbit of a view of the
+    // init() size, and waits for the upload; the renders then color with the
+    // first palette, contrast enhanced, and end with glFinish().
+    void prepare(const CpuView& view);
+    void renderFragment(bool distance = false);
+    void renderCompute(bool supersample = false, bool distance = false);
+
+    // Smooth counts of the fragment path, rendered into a float target
+    void fragmentIterations(std::vector<float>& mu);
+
+private:
+    void allocate(int newWidth, int newHeight);
+    void usePalette(int index);
+    void draw(ProgramVariants& programs, const VariantKey& key);
+
+    const std::vector<Palette> palettes;
+    OrbitCache orbits;
+    GLFWwindow* window = nullptr;
+    bool computeSupported = false;
+    bool perturb = false;
+    int maxIterations = 0;
+    int width = 0, height = 0;
+    int uploadedPalette = -1;
+    GLuint vao = 0, vbo = 0, viewStateBuffer = 0, fbo = 0, fboTexture = 0;
+    GLuint iterationFbo = 0, iterationTexture = 0;
+    GLuint orbitBuffer = 0, orbitTexture = 0;
+    GLuint paletteTexture = 0;
+    GLint maxOrbitLength = 0;
+    ComputePasses passes;
+    ProgramVariants fragmentPrograms{buildFragmentProgram};
+    ProgramVariants iterationPrograms{[](const std::string& defines) {
+        return buildFragmentProgram(defines + "#define OUTPUT_ITERATIONS\n");
+    }};
+    ProgramVariants colorizePrograms{buildColorizeProgram};
+};
@@ -0,0 +1,92 @@
+#include "image_io.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+#include <zlib.h>
+
+namespace {
+
+void appendBigEndian(std::vector<uint8_t>& out, uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8) out.push_back((uint8_t)(value >> shift));
+}
+
+// Length, type, data, then the CRC of type and data
+void appendChunk(std::vector<uint8_t>& out, const char* type, const uint8_t* data, size_t size) {
+    appendBigEndian(out, (uint32_t)size);
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data, data + size);
+    appendBigEndian(out, (uint32_t)crc32(0, out.data() + start, (uInt)(out.size() - start)));
+}
+
+} // namespace
+
+bool writePpm(const std::string& path, int width, int height, const uint8_t* rgb) {
+    std::ofstream out(path, std::ios::binary);
+    if (!out) {
+        std::cerr << "Failed to open " << path << std::endl;
+        return false;
+    }
+    // PPM rows run top-down
+    out << "P6\n" << width << " " << height << "\n255\n";
+    for (int y = height - 1; y >= 0; y--) out.write((const char*)rgb + (size_t)y * width * 3, (size_t)width * 3);
+    return (bool)out;
+}
+
+bool encodePng(int width, int height, const uint8_t* rgb, std::vector<uint8_t>& png, int level) {
+    // Rows top-down, each behind a filter type byte; 0 leaves the row as is
+    size_t stride = (size_t)width * 3;
+    std::vector<uint8_t> raw((stride + 1) * height);
+    for (int y = 0; y < height; y++) {
+        uint8_t* row = &raw[(size_t)y * (stride + 1)];
+        row[0] = 0;
+        std::copy(rgb + (size_t)(height - 1 - y) * stride, rgb + (size_t)(height - y) * stride, row + 1);
+    }
+    uLongf deflatedSize = compressBound((uLong)raw.size());
+    std::vector<uint8_t> deflated(deflatedSize);
+    if (compress2(deflated.data(), &deflatedSize, raw.data(), (uLong)raw.size(), level) != Z_OK) {
+        std::cerr << "Failed to deflate a " << width << "x" << height << " PNG" << std::endl;
+        return false;
+    }
+
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    png.assign(signature, signature + 8);
+    std::vector<uint8_t> header;
+    appendBigEndian(header, (uint32_t)width);
+    appendBigEndian(header, (uint32_t)height);
+    header.insert(header.end(), {8, 2, 0, 0, 0});  // 8-bit RGB, deflate, adaptive filtering, no interlace
+    appendChunk(png, "IHDR", header.data(), header.size());
+    appendChunk(png, "IDAT", deflated.data(), deflatedSize);
+    appendChunk(png, "IEND", nullptr, 0);
+    return true;
+}
+
+bool writePfm(const std::string& path, int width, int height, const float* values) {
+    std::ofstream out(path, std::ios::binary);
+    if (!out) {
+        std::cerr << "Failed to open " << path << std::endl;
+        return false;
+    }
+    out << "Pf\n" << width << " " << height << "\n-1.0\n";
+    out.write((const char*)values, (size_t)width * height * sizeof(float));
+    return (bool)out;
+}
+
+bool readPfm(const std::string& path, int& width, int& height, std::vector<float>& values) {
+    std::ifstream in(path, std::ios::binary);
+    std::string magic;
+    double scale;
+    if (!(in >> magic >> width >> height >> scale) || magic != "Pf" || scale >= 0.0 || width <= 0 || height <= 0) {
+        std::cerr << "Cannot read " << path << std::endl;
+        return false;
+    }
+    in.get();
+    values.resize((size_t)width * height);
+    if (!in.read((char*)values.data(), values.size() * sizeof(float))) {
+        std::cerr << "Truncated " << path << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Minimal image files for the tools. Buffers are in the engines' layout: rows
+// bottom-up, like gl_FragCoord.
+
+// Binary PPM from packed RGB8
+bool writePpm(const std::string& path, int width, int height, const uint8_t* rgb);
+
+// PNG file contents from packed RGB8, deflated with zlib at the given level (0-9)
+bool encodePng(int width, int height, const uint8_t* rgb, std::vector<uint8_t>& png, int level = 6);
+
+// Greyscale PFM: a text header, then little-endian floats with rows bottom-up
+bool writePfm(const std::string& path, int width, int height, const float* values);
+bool readPfm(const std::string& path, int& width, int& height, std::vector<float>& values);
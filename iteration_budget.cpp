@@ -0,0 +1,132 @@
+#include "iteration_budget.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+const int probeWidth = 48;        // samples across the longer side of the view
+const int initialCap = 4096;      // largest budget a fresh probe starts from
+// The probe sees one sample per ~17x17 pixels; the full-resolution image has
+// boundary pixels that escape later than any sample did
+const double samplingHeadroom = 1.25;
+const long workPerUpdate = 1000000;  // iteration steps the probe may take per frame
+
+// Re-probe once the view has zoomed by more than this factor or panned by this
+// fraction of its extent; smaller changes keep the current budget
+const double rezoomFactor = 1.25;
+const double repanFraction = 0.25;
+
+// Cheap interior test: main cardioid and period-2 bulb never escape
+bool knownInterior(long double x, long double y) {
+    long double q = (x - 0.25L) * (x - 0.25L) + y * y;
+    if (q * (q + (x - 0.25L)) <= 0.25L * y * y) return true;
+    return (x + 1) * (x + 1) + y * y <= 0.0625L;
+}
+
+} // namespace
+
+IterationBudget::IterationBudget(int minBudget, int maxBudget, double resolvedFraction)
+    : minBudget(minBudget), maxBudget(maxBudget), resolvedFraction(resolvedFraction), current(minBudget) {}
+
+int IterationBudget::update(double centerX, double centerY, double zoom, int width, int height, bool idle) {
+    if (width <= 0 || height <= 0) return current;
+
+    bool moved = samples.empty()
+        || zoom > probeZoom * rezoomFactor || zoom < probeZoom / rezoomFactor
+        || std::fabs(centerX - probeX) > repanFraction * zoom
+        || std::fabs(centerY - probeY) > repanFraction * zoom;
+    if (moved) {
+        startProbe(centerX, centerY, zoom, width, height);
+        // A probe cut short by the work limit keeps the old budget until later frames finish it
+        if (extendProbe()) pickBudget();
+        return current;
+    }
+
+    if (resumeAt > 0) {
+        if (extendProbe()) pickBudget();
+    } else if (idle && !settled && probeCap < maxBudget) {
+        probeCap = std::min(probeCap * 2, maxBudget);
+        if (extendProbe()) pickBudget();
+    }
+    return current;
+}
+
+void IterationBudget::startProbe(double centerX, double centerY, double zoom, int width, int height) {
+    probeX = centerX;
+    probeY = centerY;
+    probeZoom = zoom;
+    probeCap = std::max(minBudget, std::min(current, initialCap));
+    resumeAt = 0;
+    settled = false;
+
+    // Same pixel-to-plane mapping as the shaders, at probe resolution
+    int longer = std::max(width, height);
+    int w = std::max(1, probeWidth * width / longer);
+    int h = std::max(1, probeWidth * height / longer);
+    double minRes = std::min(w, h);
+    samples.assign((size_t)w * h, Sample());
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            Sample& s = samples[(size_t)y * w + x];
+            s.cx = (long double)centerX + (long double)((x + 0.5 - 0.5 * w) / minRes) * zoom;
+            s.cy = (long double)centerY + (long double)((y + 0.5 - 0.5 * h) / minRes) * zoom;
+            s.interior = knownInterior(s.cx, s.cy);
+        }
+    }
+}
+
+bool IterationBudget::extendProbe() {
+    long work = 0;
+    for (size_t i = resumeAt; i < samples.size(); i++) {
+        Sample& s = samples[i];
+        if (s.escaped || s.interior || s.iter >= probeCap) continue;
+        if (work >= workPerUpdate) {
+            resumeAt = i;
+            return false;
+        }
+        long double zx = s.zx, zy = s.zy;
+        int iter = s.iter;
+        while (iter < probeCap && zx * zx + zy * zy < 16) {
+            long double next = zx * zx - zy * zy + s.cx;
+            zy = 2 * zx * zy + s.cy;
+            zx = next;
+            iter++;
+        }
+        work += iter - s.iter;
+        s.zx = zx;
+        s.zy = zy;
+        s.iter = iter;
+        s.escaped = zx * zx + zy * zy >= 16;
+    }
+    resumeAt = 0;
+    return true;
+}
+
+void IterationBudget::pickBudget() {
+    std::vector<int> escapes;
+    int lateEscapes = 0, pending = 0;
+    for (const Sample& s : samples) {
+        if (s.escaped) {
+            escapes.push_back(s.iter);
+            if (s.iter > probeCap / 2) lateEscapes++;
+        } else if (!s.interior) {
+            pending++;
+        }
+    }
+    // Nothing escaped in the upper half of the range: a higher cap would only
+    // spend more time on interior points. With no escapes at all we are deep
+    // enough that even the fastest pixels need more than the cap, so keep going.
+    settled = pending == 0 || (!escapes.empty() && lateEscapes == 0);
+
+    int needed = minBudget;
+    if (!escapes.empty()) {
+        size_t k = (size_t)std::ceil(resolvedFraction * escapes.size()) - 1;
+        k = std::min(k, escapes.size() - 1);
+        std::nth_element(escapes.begin(), escapes.begin() + k, escapes.end());
+        needed = (int)(escapes[k] * samplingHeadroom);
+    }
+    // Boundary samples are still escaping near the cap, so the image needs at least that much
+    if (!settled) needed = std::max(needed, probeCap);
+    current = std::min(std::max(needed, minBudget), maxBudget);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Chooses maxIterations from a coarse CPU probe of the current view instead of
+// a fixed function of zoom. The probe records when each sample escapes; the
+// budget is the smallest count that resolves the requested fraction of the
+// escaping (boundary) samples. While the view is idle the probe keeps iterating
+// the samples that have not escaped yet, raising the budget step by step for as
+// long as more of them keep escaping.
+class IterationBudget {
+public:
+    IterationBudget(int minBudget = 256, int maxBudget = 1 << 16, double resolvedFraction = 0.999);
+
+    // Returns the budget for this frame. Re-probes if the view has moved
+    // noticeably since the last probe; raises the probe's cap only when idle.
+    int update(double centerX, double centerY, double zoom, int width, int height, bool idle);
+
+    int budget() const { return current; }
+
+private:
+    struct Sample {
+        long double cx, cy;
+        long double zx = 0, zy = 0;
+        int iter = 0;
+        bool escaped = false;
+        bool interior = false;  // inside the main cardioid or period-2 bulb
+    };
+
+    void startProbe(double centerX, double centerY, double zoom, int width, int height);
+    // Iterates unescaped samples up to probeCap; false if the work limit ran out first
+    bool extendProbe();
+    void pickBudget();
+
+    int minBudget, maxBudget;
+    double resolvedFraction;
+
+    std::vector<Sample> samples;
+    double probeX = 0.0, probeY = 0.0, probeZoom = 0.0;
+    int probeCap = 0;
+    size_t resumeAt = 0;   // next sample to extend when a pass was cut short
+    bool settled = false;  // raising the cap no longer resolves more samples
+    int current;
+};
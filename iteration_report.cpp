@@ -0,0 +1,97 @@
+#include "iteration_report.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+#include "colorize.h"
+#include "image_io.h"
+
+double IterationReport::clampedFraction() const {
+    size_t pixels = (size_t)width * height;
+    return pixels ? (double)clampedPixels / pixels : 0.0;
+}
+
+double IterationReport::meanIterations() const {
+    size_t pixels = (size_t)width * height;
+    return pixels ? (double)totalIterations / pixels : 0.0;
+}
+
+IterationReport makeIterationReport(const uint32_t* counts, const float* mu, int width, int height, int maxIterations,
+                                    int bins) {
+    IterationReport report;
+    report.width = width;
+    report.height = height;
+    report.maxIterations = maxIterations;
+    report.binWidth = std::max(1, (maxIterations + bins - 1) / bins);
+    int binCount = (maxIterations + report.binWidth - 1) / report.binWidth;
+    report.binPixels.assign(std::max(binCount, 1), 0);
+    report.binIterations.assign(report.binPixels.size(), 0);
+
+    size_t pixels = (size_t)width * height;
+    for (size_t i = 0; i < pixels; i++) {
+        uint32_t n = counts[i];
+        report.totalIterations += n;
+        if (mu[i] >= (float)maxIterations) {
+            report.clampedPixels++;
+            report.clampedIterations += n;
+            continue;
+        }
+        size_t bin = n / report.binWidth;
+        report.binPixels[bin]++;
+        report.binIterations[bin] += n;
+    }
+    return report;
+}
+
+bool writeHistogramCsv(const std::string& path, const IterationReport& report) {
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "Failed to open " << path << std::endl;
+        return false;
+    }
+    out << "first,last,pixels,iterations\n";
+    for (size_t bin = 0; bin < report.binPixels.size(); bin++) {
+        int first = (int)bin * report.binWidth;
+        int last = std::min(first + report.binWidth, report.maxIterations) - 1;
+        out << first << "," << last << "," << report.binPixels[bin] << "," << report.binIterations[bin] << "\n";
+    }
+    out << report.maxIterations << "," << report.maxIterations << "," << report.clampedPixels << ","
+        << report.clampedIterations << "\n";
+    return (bool)out;
+}
+
+void iterationHeatmap(const uint32_t* counts, size_t count, int maxIterations, uint8_t* rgb) {
+    float scale = 1.0f / std::log1p((float)std::max(maxIterations, 1));
+    for (size_t i = 0; i < count; i++, rgb += 3) {
+        float t = std::log1p((float)counts[i]) * scale;
+        rgb[0] = toUnorm8(3.0f * t);
+        rgb[1] = toUnorm8(3.0f * t - 1.0f);
+        rgb[2] = toUnorm8(3.0f * t - 2.0f);
+    }
+}
+
+std::string formatReport(const IterationReport& report) {
+    char text[256];
+    std::snprintf(text, sizeof(text), "%dx%d, %llu iterations (%.1f per pixel), %.2f%% of pixels inside, maxIterations %d",
+                  report.width, report.height, (unsigned long long)report.totalIterations, report.meanIterations(),
+                  report.clampedFraction() * 100.0, report.maxIterations);
+    return text;
+}
+
+bool exportIterationReport(const std::string& prefix, int width, int height, int maxIterations,
+                           const uint32_t* counts, const float* mu, const uint8_t* rgb, IterationReport& report) {
+    size_t pixels = (size_t)width * height;
+    report = makeIterationReport(counts, mu, width, height, maxIterations);
+
+    std::vector<uint8_t> heat(pixels * 3);
+    iterationHeatmap(counts, pixels, maxIterations, heat.data());
+    std::vector<float> raw(counts, counts + pixels);
+
+    return writePpm(prefix + ".ppm", width, height, rgb)
+        && writePpm(prefix + "-heatmap.ppm", width, height, heat.data())
+        && writePfm(prefix + "-counts.pfm", width, height, raw.data())
+        && writeHistogramCsv(prefix + "-histogram.csv", report);
+}
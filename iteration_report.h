@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Where a frame's iterations go: totals, the share of pixels that ran into the
+// maxIterations clamp, and a histogram of per-pixel iteration counts.
+struct IterationReport {
+    int width = 0, height = 0;
+    int maxIterations = 0;
+    uint64_t totalIterations = 0;
+    // Never escaped: ran into maxIterations, or periodicity detection or an
+    // interior disc settled them sooner
+    uint64_t clampedPixels = 0;
+    uint64_t clampedIterations = 0;
+    // Escaped pixels by count, in bins of binWidth starting at 0
+    int binWidth = 1;
+    std::vector<uint64_t> binPixels;
+    std::vector<uint64_t> binIterations;
+
+    double clampedFraction() const;
+    double meanIterations() const;
+};
+
+// Pixels count as escaped by their smooth count mu, since their raw count stops
+// short of maxIterations when the interior is caught early
+IterationReport makeIterationReport(const uint32_t* counts, const float* mu, int width, int height, int maxIterations,
+                                    int bins = 256);
+
+// One row per bin, plus a last row for the clamped pixels
+bool writeHistogramCsv(const std::string& path, const IterationReport& report);
+
+// Per-pixel cost as RGB8, black through red and yellow to white on a log scale
+void iterationHeatmap(const uint32_t* counts, size_t count, int maxIterations, uint8_t* rgb);
+
+std::string formatReport(const IterationReport& report);
+
+// Writes prefix.ppm (the image), prefix-heatmap.ppm, prefix-counts.pfm (raw
+// counts as floats) and prefix-histogram.csv
+bool exportIterationReport(const std::string& prefix, int width, int height, int maxIterations,
+                           const uint32_t* counts, const float* mu, const uint8_t* rgb, IterationReport& report);
@@ -1,220 +1,397 @@
-#define GL_SILENCE_DEPRECATION
 #define GLFW_INCLUDE_NONE
 #include <GLFW/glfw3.h>
-#include <OpenGL/gl3.h>
+#include "gl_includes.h"
 #include <iostream>
 #include <string>
 #include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <vector>
 
-// Shaders
-const char* vertexShaderSource = R"(
-#version 410 core
-layout (location = 0) in vec2 aPos;
-void main() {
-    gl_Position = vec4(aPos, 0.0, 1.0);
-}
-)";
+#include "cpu_renderer.h"
+#include "frame_capture.h"
+#include "frame_stats.h"
+#include "gl_renderer.h"
+#include "iteration_budget.h"
+#include "iteration_report.h"
+#include "orbit.h"
+#include "resolution_controller.h"
+#include "shaders.h"
+#include "tile_stream.h"
+#include "trace.h"
+#include "view_params.h"
 
-const char* fragmentShaderSource = R"(
-#version 410 core
-out vec4 FragColor;
-uniform vec2 u_resolution;
-uniform dvec2 u_center;
-uniform double u_zoom;
-uniform int u_maxIterations;
-uniform int u_palette;
-uniform bool u_contrastEnhance;
+// What the viewer shows and how. main() owns it and the GLFW callbacks reach
+// it through the window's user pointer. Input replaces view with a changed
+// copy, and each frame renders from a snapshot of view taken after polling.
+struct Viewer {
+    ViewParams view;
+    int windowWidth = 800, windowHeight = 600;
+    // Loaded from --palettes, or the built-in ones; selected with 1-9, [ and ]
+    std::vector<Palette> palettes;
+    bool computeSupported = false;
+    bool useCompute = false;
+    bool useCpu = false;
+    bool showHud = false;
+    // Set by X; the next frame writes the view with its iteration report
+    bool exportRequested = false;
+    int exportCount = 0;
+    // Set by P; the next frame saves what the window shows as a PNG
+    bool screenshotRequested = false;
+    int screenshotCount = 0;
+    // Toggled by R: every frame the window shows goes to recordDir as a PNG
+    bool recording = false;
+    std::string recordDir;
+    int recordingCount = 0;
 
-void main() {
-    vec2 uv = (gl_FragCoord.xy - 0.5 * u_resolution.xy) / min(u_resolution.y, u_resolution.x);
+    double mouseX = 0, mouseY = 0;
+    double lastMouseX = 0, lastMouseY = 0;
+    bool dragging = false;
+    bool zooming = false;
+    bool panning = false;
 
-    // We use double precision for the Mandelbrot calculation to allow deeper zooming
-    dvec2 c = u_center + dvec2(uv) * u_zoom;
-    dvec2 z = dvec2(0.0);
-    int iter = 0;
+    // Bumped by every input that changes what is iterated; CPU render jobs for an
+    // older generation abandon their remaining tiles. Coloring changes recolor the
+    // finished frame instead.
+    std::atomic<uint64_t> viewGeneration{0};
+};
 
-    while (dot(z, z) < 16.0 && iter < u_maxIterations) {
-        z = dvec2(z.x * z.x - z.y * z.y + c.x, 2.0 * z.x * z.y + c.y);
-        iter++;
-    }
+Viewer& viewerOf(GLFWwindow* window) {
+    return *static_cast<Viewer*>(glfwGetWindowUserPointer(window));
+}
 
-    if (iter >= u_maxIterations) {
-        FragColor = vec4(0.0, 0.0, 0.0, 1.0);
-    } else {
-        // Smooth iteration count
-        float dist = length(vec2(z));
-        float smooth_iter = float(iter) - log2(log2(dist)) + 4.0;
-        
-        // Increase color frequency as we zoom in to maintain contrast/detail
-        float color_freq = 0.1;
-        if (u_contrastEnhance) {
-            float zoom_log = max(0.0, float(-log(float(u_zoom)) / log(10.0)));
-            color_freq += zoom_log * 0.05;
-        }
-        
-        float t = smooth_iter * color_freq;
-        
-        vec3 color;
-        if (u_palette == 0) {
-            // Original rainbow
-            color = 0.5 + 0.5 * cos(3.0 + t + vec3(0.0, 0.6, 1.0));
-        } else if (u_palette == 1) {
-            // Fiery
-            color = 0.5 + 0.5 * cos(3.0 + t + vec3(0.0, 0.1, 0.2));
-        } else if (u_palette == 2) {
-            // Ocean
-            color = 0.5 + 0.5 * cos(3.0 + t + vec3(0.5, 0.6, 0.0));
-        } else if (u_palette == 3) {
-            // Grayscaleish
-            float gray = 0.5 + 0.5 * cos(3.0 + t);
-            color = vec3(gray);
-        } else if (u_palette == 4) {
-            // Electric
-            color = 0.5 + 0.5 * cos(3.0 + t * 2.0 + vec3(0.0, 0.3, 0.6));
-        } else if (u_palette == 5) {
-            // Neon
-            color = vec3(0.5 + 0.5 * sin(t), 0.5 + 0.5 * sin(t + 2.0), 0.5 + 0.5 * sin(t + 4.0));
-        } else if (u_palette == 6) {
-            // Gold/Bronze
-            color = 0.5 + 0.5 * cos(3.0 + t + vec3(0.1, 0.2, 0.5));
-        } else {
-            color = vec3(1.0);
-        }
-        
-        FragColor = vec4(color, 1.0);
+void startRecording(Viewer& viewer, const std::string& directory) {
+    std::error_code ec;
+    std::filesystem::create_directories(directory, ec);
+    if (ec) {
+        std::cerr << "Failed to create " << directory << ": " << ec.message() << std::endl;
+        return;
     }
+    viewer.recording = true;
+    viewer.recordDir = directory;
+    std::cout << "Recording to " << directory << std::endl;
 }
-)";
 
-// State
-double centerX = -0.5, centerY = 0.0;
-double zoom = 2.0;
-int maxIterations = 256;
-double mouseX = 0, mouseY = 0;
-int width = 800, height = 600;
-int windowWidth = 800, windowHeight = 600;
-int currentPalette = 0;
-bool contrastEnhance = true;
-
-bool dragging = false;
-bool zooming = false;
-bool panning = false;
-double lastMouseX = 0, lastMouseY = 0;
-
-// int getIterations(double c_re, double c_im, int maxIter) {
-//     double z_re = 0, z_im = 0;
-//     int iter = 0;
-//     while (z_re * z_re + z_im * z_im < 4.0 && iter < maxIter) {
-//         double next_re = z_re * z_re - z_im * z_im + c_re;
-//         z_im = 2.0 * z_re * z_im + c_im;
-//         z_re = next_re;
-//         iter++;
-//     }
-//     return iter;
-// }
+void reportRecording(const CaptureSequence& sequence) {
+    std::cout << "Recorded " << sequence.written << " frames to " << sequence.directory << std::endl;
+    if (sequence.dropped > 0)
+        std::cerr << "Dropped " << sequence.dropped << " frames of " << sequence.directory
+                  << " the encoders fell behind on" << std::endl;
+}
+
+// Frame time the render scale is tuned for while the view is moving
+const double movingFrameBudgetMs = 16.0;
+
+// Jittered frames averaged into the displayed image while the view holds
+// still; after that the viewer only redisplays it
+const int accumulationFrames = 64;
 
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
-    zooming = true;
+    Viewer& viewer = viewerOf(window);
+    const ViewParams& view = viewer.view;
+    viewer.zooming = true;
     double zoomFactor = (yoffset > 0) ? 0.9 : 1.1;
     
     // Scale mouse coordinates to framebuffer coordinates
-    double fbMouseX = mouseX * (double)width / windowWidth;
+    double fbMouseX = viewer.mouseX * (double)view.width / viewer.windowWidth;
     // Flip Y because GLFW is top-down and OpenGL is bottom-up
-    double fbMouseY = (windowHeight - mouseY) * (double)height / windowHeight;
+    double fbMouseY = (viewer.windowHeight - viewer.mouseY) * (double)view.height / viewer.windowHeight;
 
-    double minRes = std::min(width, height);
-    double uv_x = (fbMouseX - 0.5 * width) / minRes;
-    double uv_y = (fbMouseY - 0.5 * height) / minRes;
-
-    double oldZoom = zoom;
-    zoom *= zoomFactor;
-    
-    centerX += uv_x * (oldZoom - zoom);
-    centerY += uv_y * (oldZoom - zoom);
+    viewer.view = view.zoomedAt(fbMouseX, fbMouseY, zoomFactor);
+    viewer.viewGeneration++;
 }
 
 void cursor_position_callback(GLFWwindow* window, double xpos, double ypos) {
-    if (dragging) {
-        double deltaX = xpos - lastMouseX;
-        double deltaY = ypos - lastMouseY;
+    Viewer& viewer = viewerOf(window);
+    if (viewer.dragging) {
+        double deltaX = xpos - viewer.lastMouseX;
+        double deltaY = ypos - viewer.lastMouseY;
         
         if (deltaX != 0 || deltaY != 0) {
-            panning = true;
-            double fbDeltaX = deltaX * (double)width / windowWidth;
-            double fbDeltaY = deltaY * (double)height / windowHeight;
+            viewer.panning = true;
+            const ViewParams& view = viewer.view;
+            double fbDeltaX = deltaX * (double)view.width / viewer.windowWidth;
+            double fbDeltaY = deltaY * (double)view.height / viewer.windowHeight;
             
-            double minRes = std::min(width, height);
-            centerX -= (fbDeltaX / minRes) * zoom;
             // Flip Y because GLFW is top-down and OpenGL is bottom-up
-            centerY += (fbDeltaY / minRes) * zoom;
+            viewer.view = view.pannedBy(fbDeltaX, -fbDeltaY);
+            viewer.viewGeneration++;
         }
     }
-    mouseX = xpos;
-    mouseY = ypos;
-    lastMouseX = xpos;
-    lastMouseY = ypos;
+    viewer.mouseX = xpos;
+    viewer.mouseY = ypos;
+    viewer.lastMouseX = xpos;
+    viewer.lastMouseY = ypos;
 }
 
 void mouse_button_callback(GLFWwindow* window, int button, int action, int mods) {
+    Viewer& viewer = viewerOf(window);
     if (button == GLFW_MOUSE_BUTTON_LEFT) {
         if (action == GLFW_PRESS) {
-            dragging = true;
-            glfwGetCursorPos(window, &lastMouseX, &lastMouseY);
+            viewer.dragging = true;
+            glfwGetCursorPos(window, &viewer.lastMouseX, &viewer.lastMouseY);
         } else if (action == GLFW_RELEASE) {
-            dragging = false;
+            viewer.dragging = false;
         }
     }
 }
 
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+    Viewer& viewer = viewerOf(window);
     if (action == GLFW_PRESS) {
-        if (key >= GLFW_KEY_1 && key <= GLFW_KEY_7) {
-            currentPalette = key - GLFW_KEY_1;
+        ViewParams view = viewer.view;
+        const std::vector<Palette>& palettes = viewer.palettes;
+        int palette = view.palette;
+        if (key >= GLFW_KEY_1 && key <= GLFW_KEY_9 && key - GLFW_KEY_1 < (int)palettes.size()) {
+            palette = key - GLFW_KEY_1;
+        }
+        if (key == GLFW_KEY_LEFT_BRACKET) {
+            palette = (view.palette + (int)palettes.size() - 1) % (int)palettes.size();
+        }
+        if (key == GLFW_KEY_RIGHT_BRACKET) {
+            palette = (view.palette + 1) % (int)palettes.size();
+        }
+        if (palette != view.palette) {
+            view.palette = palette;
+            std::cout << "Palette " << palette + 1 << ": " << palettes[palette].name << std::endl;
         }
         if (key == GLFW_KEY_Q) {
-            contrastEnhance = !contrastEnhance;
+            view.contrastEnhance = !view.contrastEnhance;
+        }
+        if (key == GLFW_KEY_H) {
+            viewer.showHud = !viewer.showHud;
+        }
+        if (key == GLFW_KEY_C && viewer.computeSupported) {
+            viewer.useCompute = !viewer.useCompute;
+            std::cout << (viewer.useCompute ? "Compute path" : "Fragment path") << std::endl;
+        }
+        // Histogram coloring and supersampling need the compute path or the CPU engine
+        if (key == GLFW_KEY_G) {
+            view.histogram = !view.histogram;
+            if (view.histogram && !viewer.useCpu && !viewer.useCompute) {
+                if (viewer.computeSupported) viewer.useCompute = true;
+                else std::cout << "Histogram coloring needs the compute path; press E for the CPU engine" << std::endl;
+            }
+            std::cout << (view.histogram ? "Histogram coloring" : "Palette coloring") << std::endl;
         }
+        if (key == GLFW_KEY_A) {
+            view.supersample = !view.supersample;
+            if (view.supersample && !viewer.useCpu && !viewer.useCompute) {
+                if (viewer.computeSupported) viewer.useCompute = true;
+                else std::cout << "Supersampling needs the compute path; press E for the CPU engine" << std::endl;
+            }
+            std::cout << (view.supersample ? "Supersampling on" : "Supersampling off") << std::endl;
+        }
+        // Distance estimation also limits supersampling to near the set
+        if (key == GLFW_KEY_D) {
+            view.distanceEstimate = !view.distanceEstimate;
+            std::cout << (view.distanceEstimate ? "Distance estimation on" : "Distance estimation off") << std::endl;
+        }
+        if (key == GLFW_KEY_X) {
+            viewer.exportRequested = true;
+        }
+        if (key == GLFW_KEY_P) {
+            viewer.screenshotRequested = true;
+        }
+        if (key == GLFW_KEY_R) {
+            if (viewer.recording) {
+                viewer.recording = false;
+            } else {
+                startRecording(viewer, "recording-" + std::to_string(++viewer.recordingCount));
+            }
+        }
+        if (key == GLFW_KEY_E) {
+            viewer.useCpu = !viewer.useCpu;
+            std::cout << (viewer.useCpu ? "CPU engine" : "GPU engine") << std::endl;
+            viewer.viewGeneration++;
+        }
+        viewer.view = view;
     }
 }
 
 void framebuffer_size_callback(GLFWwindow* window, int w, int h) {
-    width = w;
-    height = h;
-    glfwGetWindowSize(window, &windowWidth, &windowHeight);
+    Viewer& viewer = viewerOf(window);
+    viewer.view = viewer.view.resized(w, h);
+    glfwGetWindowSize(window, &viewer.windowWidth, &viewer.windowHeight);
     glViewport(0, 0, w, h);
+    viewer.viewGeneration++;
 }
 
-GLuint compileShader(GLenum type, const char* source) {
-    GLuint shader = glCreateShader(type);
-    glShaderSource(shader, 1, &source, NULL);
-    glCompileShader(shader);
-    
-    int success;
-    char infoLog[512];
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(shader, 512, NULL, infoLog);
-        std::cerr << "Shader Compilation Error: " << infoLog << std::endl;
+// Measures the per-frame CPU cost of the three ways of getting view state to the
+// shader: looking locations up by name, cached locations, and one block upload.
+void benchmarkUniformUpload(GLuint vao) {
+    const char* looseUniformsSource = R"(
+#version 410 core
+out vec4 FragColor;
+uniform vec2 u_resolution;
+uniform dvec2 u_center;
+uniform double u_zoom;
+uniform int u_maxIterations;
+uniform int u_palette;
+uniform bool u_contrastEnhance;
+void main() {
+    FragColor = vec4(float(u_center.x + u_zoom) + u_resolution.x, float(u_maxIterations + u_palette), u_contrastEnhance ? 1.0 : 0.0, 1.0);
+}
+)";
+    const char* blockSource = R"(
+out vec4 FragColor;
+void main() {
+    FragColor = vec4(float(u_center.x + u_zoom) + u_resolution.x, float(u_maxIterations + u_orbitLength), 1.0, 1.0);
+}
+)";
+    GLuint looseProgram = linkProgram({
+        compileShader(GL_VERTEX_SHADER, {vertexShaderSource}),
+        compileShader(GL_FRAGMENT_SHADER, {looseUniformsSource})
+    });
+    GLuint blockProgram = linkProgram({
+        compileShader(GL_VERTEX_SHADER, {vertexShaderSource}),
+        compileShader(GL_FRAGMENT_SHADER, {"#version 410 core\n", viewUniformsSource, blockSource})
+    });
+    bindViewState(blockProgram);
+
+    // Draw into a single pixel so the measurement is dominated by CPU-side work
+    GLuint fbo, texture, ubo;
+    glGenFramebuffers(1, &fbo);
+    glGenTextures(1, &texture);
+    glGenBuffers(1, &ubo);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+    glViewport(0, 0, 1, 1);
+    glBindVertexArray(vao);
+    glBindBufferBase(GL_UNIFORM_BUFFER, viewStateBinding, ubo);
+
+    const int frames = 20000;
+    auto run = [&](const char* name, GLuint program, auto upload) {
+        glUseProgram(program);
+        glFinish();
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < frames; i++) {
+            upload(i);
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+        }
+        glFinish();
+        double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        std::printf("  %-18s %8.3f us/frame\n", name, us / frames);
+    };
+
+    std::printf("Uniform upload, %d frames:\n", frames);
+    run("lookup by name", looseProgram, [&](int i) {
+        glUniform2f(glGetUniformLocation(looseProgram, "u_resolution"), 1.0f, 1.0f);
+        glUniform2d(glGetUniformLocation(looseProgram, "u_center"), -0.5 + i * 1e-9, 0.0);
+        glUniform1d(glGetUniformLocation(looseProgram, "u_zoom"), 2.0);
+        glUniform1i(glGetUniformLocation(looseProgram, "u_maxIterations"), 256);
+        glUniform1i(glGetUniformLocation(looseProgram, "u_palette"), 0);
+        glUniform1i(glGetUniformLocation(looseProgram, "u_contrastEnhance"), 1);
+    });
+
+    GLint resolutionLoc = glGetUniformLocation(looseProgram, "u_resolution");
+    GLint centerLoc = glGetUniformLocation(looseProgram, "u_center");
+    GLint zoomLoc = glGetUniformLocation(looseProgram, "u_zoom");
+    GLint maxIterationsLoc = glGetUniformLocation(looseProgram, "u_maxIterations");
+    GLint paletteLoc = glGetUniformLocation(looseProgram, "u_palette");
+    GLint contrastLoc = glGetUniformLocation(looseProgram, "u_contrastEnhance");
+    run("cached locations", looseProgram, [&](int i) {
+        glUniform2f(resolutionLoc, 1.0f, 1.0f);
+        glUniform2d(centerLoc, -0.5 + i * 1e-9, 0.0);
+        glUniform1d(zoomLoc, 2.0);
+        glUniform1i(maxIterationsLoc, 256);
+        glUniform1i(paletteLoc, 0);
+        glUniform1i(contrastLoc, 1);
+    });
+
+    run("uniform block", blockProgram, [&](int i) {
+        ViewStateBlock block = {};
+        block.center[0] = -0.5 + i * 1e-9;
+        block.zoom = 2.0;
+        block.resolution[0] = block.resolution[1] = 1.0f;
+        block.maxIterations = 256;
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(block), &block, GL_STREAM_DRAW);
+    });
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteTextures(1, &texture);
+    glDeleteBuffers(1, &ubo);
+    glDeleteProgram(looseProgram);
+    glDeleteProgram(blockProgram);
+}
+
+// Radical inverse of index in base: successive indices spread evenly over 0..1
+float halton(int index, int base) {
+    float result = 0.0f, scale = 1.0f;
+    while (index > 0) {
+        scale /= base;
+        result += scale * (index % base);
+        index /= base;
     }
-    return shader;
+    return result;
 }
 
-int main() {
+int main(int argc, char** argv) {
+    bool benchUniforms = false;
+    std::string statsPath;
+    std::string tracePath;
+    std::string paletteDir = MANDEL_PALETTE_DIR;
+    std::string recordDir;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--bench-uniforms") {
+            benchUniforms = true;
+        } else if (arg == "--stats-csv" && i + 1 < argc) {
+            statsPath = argv[++i];
+        } else if (arg == "--trace" && i + 1 < argc) {
+            tracePath = argv[++i];
+        } else if (arg == "--palettes" && i + 1 < argc) {
+            paletteDir = argv[++i];
+        } else if (arg == "--record" && i + 1 < argc) {
+            recordDir = argv[++i];
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--bench-uniforms] [--stats-csv file] [--trace file] [--palettes dir]"
+                      << " [--record dir]" << std::endl;
+            return -1;
+        }
+    }
+    Viewer viewer;
+    viewer.palettes = loadPalettes(paletteDir);
+    if (viewer.palettes.empty()) {
+        std::cerr << "No palettes in " << paletteDir << ", using the built-in ones" << std::endl;
+        viewer.palettes = builtinPalettes();
+    }
+
+    // Before any worker thread exists, so that they name themselves in the trace
+    if (!tracePath.empty() && traceStart(tracePath)) traceThreadName("main");
+
     if (!glfwInit()) return -1;
     
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 
-    GLFWwindow* window = glfwCreateWindow(width, height, "Mandelbrot GPU", NULL, NULL);
+    GLFWwindow* window = NULL;
+#ifdef MANDEL_HAVE_COMPUTE
+    // Prefer 4.3 for the compute path, but the fragment path only needs 4.1
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    window = glfwCreateWindow(viewer.view.width, viewer.view.height, "Mandelbrot GPU", NULL, NULL);
+    viewer.computeSupported = window != NULL;
+#endif
+    if (!window) {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+        window = glfwCreateWindow(viewer.view.width, viewer.view.height, "Mandelbrot GPU", NULL, NULL);
+    }
     if (!window) {
         glfwTerminate();
         return -1;
     }
     
     glfwMakeContextCurrent(window);
+    glfwSetWindowUserPointer(window, &viewer);
     glfwSetScrollCallback(window, scroll_callback);
     glfwSetCursorPosCallback(window, cursor_position_callback);
     glfwSetMouseButtonCallback(window, mouse_button_callback);
@@ -222,19 +399,23 @@ int main() {
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
     
     // Get actual framebuffer and window size
-    glfwGetFramebufferSize(window, &width, &height);
-    glfwGetWindowSize(window, &windowWidth, &windowHeight);
-    
-    GLuint vertexShader = compileShader(GL_VERTEX_SHADER, vertexShaderSource);
-    GLuint fragmentShader = compileShader(GL_FRAGMENT_SHADER, fragmentShaderSource);
+    int framebufferWidth, framebufferHeight;
+    glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+    viewer.view = viewer.view.resized(framebufferWidth, framebufferHeight);
+    glfwGetWindowSize(window, &viewer.windowWidth, &viewer.windowHeight);
     
-    GLuint shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vertexShader);
-    glAttachShader(shaderProgram, fragmentShader);
-    glLinkProgram(shaderProgram);
-    
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
+    ProgramVariants fragmentPrograms(buildFragmentProgram);
+    // Only used when the context supports the compute path
+    ProgramVariants colorizePrograms(buildColorizeProgram);
+
+    ComputePasses computePasses;
+    if (viewer.computeSupported) computePasses.init();
+    // What the compute path's iteration buffer, CDF and subsamples currently hold
+    ViewStateBlock iteratedView = {};
+    bool iterationsValid = false, cdfValid = false, refineValid = false;
+    bool iteratedDistance = false;
+    // Palette and VariantKey index of the coloring in the CPU engine's pixels, -1 for none yet
+    int cpuPalette = -1, cpuColoring = -1;
     
     float vertices[] = {
         -1.0f,  1.0f,
@@ -257,9 +438,25 @@ int main() {
     glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
     glEnableVertexAttribArray(0);
 
+    if (benchUniforms) {
+        benchmarkUniformUpload(VAO);
+        glfwTerminate();
+        return 0;
+    }
+
+    GLuint viewStateBuffer;
+    glGenBuffers(1, &viewStateBuffer);
+    glBindBufferBase(GL_UNIFORM_BUFFER, viewStateBinding, viewStateBuffer);
+
     GLuint fbo, fboTexture;
     glGenFramebuffers(1, &fbo);
     glGenTextures(1, &fboTexture);
+
+    // Running average of the static frames, in float so late samples still count
+    GLuint accumFbo, accumTexture;
+    glGenFramebuffers(1, &accumFbo);
+    glGenTextures(1, &accumTexture);
+    GLuint accumulateProgram = buildAccumulateProgram();
     
     auto setupFBO = [&](int w, int h) {
         glBindTexture(GL_TEXTURE_2D, fboTexture);
@@ -272,71 +469,403 @@ int main() {
         
         if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
             std::cerr << "Framebuffer is not complete!" << std::endl;
+
+        glBindTexture(GL_TEXTURE_2D, accumTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, w, h, 0, GL_RGBA, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindFramebuffer(GL_FRAMEBUFFER, accumFbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, accumTexture, 0);
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        if (viewer.computeSupported) computePasses.resize(w, h);
     };
 
+    GLuint orbitBuffer, orbitTexture;
+    glGenBuffers(1, &orbitBuffer);
+    glGenTextures(1, &orbitTexture);
+    GLint maxOrbitLength = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxOrbitLength);
+    std::shared_ptr<const ReferenceOrbit> uploadedOrbit;
+    int orbitLength = 0;
+
+    OrbitCache orbitCache;
+    GLuint paletteTexture = 0;
+    int uploadedPalette = -1;
+
+    FrameTimer frameTimer;
+    frameTimer.init();
+    FrameStats lastStats;
+    StatsLog statsLog;
+    ResolutionController resolution(movingFrameBudgetMs);
+    IterationBudget iterationBudget;
+    CpuRenderer cpuRenderer;
+    // Exports get an engine of their own, so they never touch the viewer's background job
+    std::unique_ptr<CpuRenderer> exportRenderer;
+    std::vector<Tile> finishedTiles;
+    TileStream tileStream;
+    tileStream.init();
+    FrameCapture frameCapture;
+    frameCapture.init();
+    std::shared_ptr<CaptureSequence> recording;
+    if (!recordDir.empty()) startRecording(viewer, recordDir);
+    if (!statsPath.empty()) statsLog.open(statsPath);
+    bool hudTitleShown = false;
+    double lastTitleUpdate = 0.0;
+
     int lastRenderWidth = -1, lastRenderHeight = -1;
+    // What accumTexture averages: the view without jitter and the coloring
+    ViewStateBlock accumulatedView = {};
+    int accumulatedColoring = -1;
+    int accumulatedFrames = 0;
     int frms = 10;
     int framesToReset = frms;
 
     while (!glfwWindowShouldClose(window)) {
+        TRACE_SCOPE("frame");
         if (framesToReset-- <= 0) {
-            zooming = false; // Reset zooming state each frame
-            panning = false; // Reset panning state each frame
+            viewer.zooming = false; // Reset zooming state each frame
+            viewer.panning = false; // Reset panning state each frame
             framesToReset = frms;
         }
-        glfwPollEvents();
-        bool isMoving = dragging || panning || zooming;
+        {
+            TRACE_SCOPE("pollEvents");
+            glfwPollEvents();
+        }
+        bool isMoving = viewer.dragging || viewer.panning || viewer.zooming;
 
-        // Optional: dynamically increase iterations as we zoom in
-        maxIterations = 256 + (int)(-log10(zoom) * 100);
-        if (maxIterations < 256) maxIterations = 256;
-        if (maxIterations > 2000) maxIterations = 2000;
+        {
+            const ViewParams& view = viewer.view;
+            viewer.view = view.withIterations(
+                iterationBudget.update(view.centerX, view.centerY, view.zoom, view.width, view.height, !isMoving));
+        }
+        // Input during this frame lands in viewer.view and shows up in the next one
+        const ViewParams params = viewer.view;
+        const Palette& palette = viewer.palettes[params.palette];
 
-        int renderWidth = isMoving ? width / 4 : width;
-        int renderHeight = isMoving ? height / 4 : height;
-        // int renderWidth = width / 4;
-        // int renderHeight = height / 4;
+        bool perturb = params.perturbed();
+        if (perturb) {
+            TRACE_SCOPE("referenceOrbit");
+            auto orbit = orbitCache.get(params.centerX, params.centerY, params.zoom, params.maxIterations);
+            if (orbit != uploadedOrbit) {
+                orbitLength = std::min(orbit->length(), (int)maxOrbitLength);
+                glBindBuffer(GL_TEXTURE_BUFFER, orbitBuffer);
+                glBufferData(GL_TEXTURE_BUFFER, orbitLength * 2 * sizeof(double), orbit->z.data(), GL_STATIC_DRAW);
+                glActiveTexture(GL_TEXTURE0 + orbitTextureUnit);
+                glBindTexture(GL_TEXTURE_BUFFER, orbitTexture);
+                glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32UI, orbitBuffer);
+                glActiveTexture(GL_TEXTURE0);
+                uploadedOrbit = orbit;
+            }
+        }
+
+        if (params.palette != uploadedPalette) {
+            glActiveTexture(GL_TEXTURE0 + paletteTextureUnit);
+            glDeleteTextures(1, &paletteTexture);
+            paletteTexture = createPaletteTexture(palette);
+            glActiveTexture(GL_TEXTURE0);
+            uploadedPalette = params.palette;
+        }
+
+        if (viewer.exportRequested) {
+            TRACE_SCOPE("export");
+            viewer.exportRequested = false;
+            CpuView exportView = cpuView(params, perturb ? uploadedOrbit : nullptr);
+            if (!exportRenderer) exportRenderer = std::make_unique<CpuRenderer>();
+            exportRenderer->render(exportView, {&palette, params.contrastEnhance}, params.supersample);
+
+            std::string prefix = "mandel-" + std::to_string(++viewer.exportCount);
+            IterationReport report;
+            if (exportIterationReport(prefix, params.width, params.height, params.maxIterations,
+                                      exportRenderer->counts().data(), exportRenderer->iterations().data(),
+                                      exportRenderer->pixels().data(), report))
+                std::cout << "Exported " << prefix << ": " << formatReport(report) << std::endl;
+        }
+
+        double renderScale = resolution.scale(params.width, params.height, isMoving);
+        int renderWidth = std::max(1, (int)(params.width * renderScale));
+        int renderHeight = std::max(1, (int)(params.height * renderScale));
+
+        frameTimer.beginFrame(renderWidth, renderHeight);
 
         if (renderWidth != lastRenderWidth || renderHeight != lastRenderHeight) {
+            frameTimer.begin(StageRealloc);
             setupFBO(renderWidth, renderHeight);
+            frameTimer.end();
+            iterationsValid = false;
             lastRenderWidth = renderWidth;
             lastRenderHeight = renderHeight;
         }
 
-        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-        glViewport(0, 0, renderWidth, renderHeight);
-        glClear(GL_COLOR_BUFFER_BIT);
-        
-        glUseProgram(shaderProgram);
-        glUniform2f(glGetUniformLocation(shaderProgram, "u_resolution"), (float)renderWidth, (float)renderHeight);
-        glUniform2d(glGetUniformLocation(shaderProgram, "u_center"), centerX, centerY);
-        glUniform1d(glGetUniformLocation(shaderProgram, "u_zoom"), zoom);
-        glUniform1i(glGetUniformLocation(shaderProgram, "u_maxIterations"), maxIterations);
-        glUniform1i(glGetUniformLocation(shaderProgram, "u_palette"), currentPalette);
-        glUniform1i(glGetUniformLocation(shaderProgram, "u_contrastEnhance"), contrastEnhance);
-        
-        glBindVertexArray(VAO);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-        
+        ViewStateBlock view = {};
+        view.center[0] = params.centerX;
+        view.center[1] = params.centerY;
+        view.zoom = params.zoom;
+        view.resolution[0] = (float)renderWidth;
+        view.resolution[1] = (float)renderHeight;
+        view.maxIterations = params.maxIterations;
+        if (perturb) {
+            view.refOffset[0] = params.centerX - uploadedOrbit->centerX;
+            view.refOffset[1] = params.centerY - uploadedOrbit->centerY;
+            view.orbitLength = orbitLength;
+        }
+        // Every frame of a still view on the GPU adds a sample, jittered within
+        // the pixel, until the average holds accumulationFrames of them. The
+        // first one is unjittered, so the first frame looks like any other.
+        int coloring = ((((params.palette * 2 + params.contrastEnhance) * 2 + params.histogram) * 2
+                         + params.supersample) * 2 + params.distanceEstimate) * 2 + viewer.useCompute;
+        bool accumulate = !viewer.useCpu && !isMoving;
+        if (!accumulate || coloring != accumulatedColoring || std::memcmp(&view, &accumulatedView, sizeof(view)) != 0)
+            accumulatedFrames = 0;
+        accumulatedView = view;
+        accumulatedColoring = coloring;
+        bool converged = accumulate && accumulatedFrames >= accumulationFrames;
+        if (accumulatedFrames > 0) {
+            view.jitter[0] = halton(accumulatedFrames, 2) - 0.5f;
+            view.jitter[1] = halton(accumulatedFrames, 3) - 0.5f;
+        }
+
+        if (!converged) {
+            TRACE_SCOPE("uploadViewState");
+            // Orphan the previous contents so we never wait on a frame still reading them
+            glBindBuffer(GL_UNIFORM_BUFFER, viewStateBuffer);
+            glBufferData(GL_UNIFORM_BUFFER, sizeof(view), &view, GL_STREAM_DRAW);
+        }
+
+        ProgramVariants& programs = viewer.useCompute ? colorizePrograms : fragmentPrograms;
+        if (viewer.useCpu) {
+            CpuView jobView = cpuView(params.resized(renderWidth, renderHeight), perturb ? uploadedOrbit : nullptr);
+
+            // Rendering continues in the background across frames; each frame
+            // uploads whatever tiles have finished since the last one
+            Colorizer colorize = {&palette, params.contrastEnhance};
+            if (!cpuRenderer.matches(jobView)) {
+                TRACE_SCOPE("startCpuJob");
+                viewer.viewGeneration++;
+                uint8_t* target = tileStream.next(renderWidth, renderHeight);
+                cpuRenderer.start(jobView, colorize, viewer.viewGeneration, target);
+                cpuPalette = params.palette;
+                cpuColoring = VariantKey{params.contrastEnhance}.index();
+            }
+
+            finishedTiles.clear();
+            cpuRenderer.takeFinishedTiles(finishedTiles);
+            {
+                TRACE_SCOPE("uploadTiles", "tiles", (int64_t)finishedTiles.size());
+                tileStream.upload(fboTexture, cpuRenderer.output(), renderWidth, finishedTiles);
+            }
+
+            uint64_t iterations;
+            double ms;
+            if (cpuRenderer.takeResult(iterations, ms)) {
+                if (cpuRenderer.refined()) {
+                    frameTimer.recordCpuStage(StageSupersample, ms);
+                } else {
+                    frameTimer.recordCpuStage(StageIterate, ms);
+                    frameTimer.recordIterations(iterations);
+                }
+            }
+
+            // Subsamples are blended in by the recolor below, once the refine pass is complete
+            if (params.supersample != cpuRenderer.refined() && cpuRenderer.complete()) {
+                if (params.supersample) cpuRenderer.refine();
+                else cpuRenderer.dropRefinement();
+                cpuColoring = -1;
+            }
+
+            // Once every tile is in, bring the frame to the current coloring from its stored counts
+            VariantKey coloring = {params.contrastEnhance, false, params.histogram};
+            if ((params.palette != cpuPalette || coloring.index() != cpuColoring) && cpuRenderer.complete()) {
+                TRACE_SCOPE("recolor");
+                auto start = std::chrono::steady_clock::now();
+                tileStream.waitForUploads();
+                if (params.histogram) cpuRenderer.equalize(palette);
+                else cpuRenderer.recolor(colorize);
+                frameTimer.recordCpuStage(StageColorize,
+                    std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+                cpuPalette = params.palette;
+                cpuColoring = coloring.index();
+                Tile frame;
+                frame.width = renderWidth;
+                frame.height = renderHeight;
+                tileStream.upload(fboTexture, cpuRenderer.output(), renderWidth, {frame});
+            }
+        } else if (!converged) {
+#ifdef MANDEL_HAVE_COMPUTE
+            // The iteration buffer outlives the frame, so a coloring change only reruns the passes after it
+            if (viewer.useCompute && (!iterationsValid || params.distanceEstimate != iteratedDistance
+                               || std::memcmp(&view, &iteratedView, sizeof(view)) != 0)) {
+                TRACE_SCOPE("dispatch");
+                frameTimer.begin(StageIterate);
+                computePasses.iterate(perturb, params.distanceEstimate, params.maxIterations);
+                frameTimer.end();
+                frameTimer.recordIterations(computePasses.counters(), 0);
+                iteratedView = view;
+                iteratedDistance = params.distanceEstimate;
+                iterationsValid = true;
+                cdfValid = false;
+                refineValid = false;
+            }
+            if (viewer.useCompute && params.histogram && !cdfValid) {
+                TRACE_SCOPE("histogram");
+                frameTimer.begin(StageHistogram);
+                computePasses.histogram();
+                frameTimer.end();
+                cdfValid = true;
+            }
+            if (viewer.useCompute && params.supersample && !refineValid) {
+                TRACE_SCOPE("supersample");
+                frameTimer.begin(StageSupersample);
+                computePasses.refine(perturb, params.distanceEstimate);
+                frameTimer.end();
+                refineValid = true;
+            }
+#endif
+
+            TRACE_SCOPE("draw");
+            glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+            glViewport(0, 0, renderWidth, renderHeight);
+            glClear(GL_COLOR_BUFFER_BIT);
+
+            glUseProgram(programs.get({params.contrastEnhance, perturb, viewer.useCompute && params.histogram,
+                                       viewer.useCompute && params.supersample, params.distanceEstimate}));
+
+            glBindVertexArray(VAO);
+            frameTimer.begin(viewer.useCompute ? StageColorize : StageIterate);
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+            frameTimer.end();
+
+            if (accumulate) {
+                TRACE_SCOPE("accumulate", "samples", accumulatedFrames + 1);
+                frameTimer.begin(StageAccumulate);
+                glBindFramebuffer(GL_FRAMEBUFFER, accumFbo);
+                glUseProgram(accumulateProgram);
+                glBindTexture(GL_TEXTURE_2D, fboTexture);
+                glEnable(GL_BLEND);
+                glBlendColor(0.0f, 0.0f, 0.0f, 1.0f / (accumulatedFrames + 1));
+                glBlendFunc(GL_CONSTANT_ALPHA, GL_ONE_MINUS_CONSTANT_ALPHA);
+                glDrawArrays(GL_TRIANGLES, 0, 6);
+                glDisable(GL_BLEND);
+                frameTimer.end();
+                accumulatedFrames++;
+            }
+        }
+
         // Blit to screen
-        glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
-        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
-        glBlitFramebuffer(0, 0, renderWidth, renderHeight, 
-                          0, 0, width, height, 
-                          GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        {
+            TRACE_SCOPE("blit");
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, accumulate ? accumFbo : fbo);
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+            frameTimer.begin(StageBlit);
+            glBlitFramebuffer(0, 0, renderWidth, renderHeight, 
+                              0, 0, params.width, params.height, 
+                              GL_COLOR_BUFFER_BIT, GL_LINEAR);
+            frameTimer.end();
+        }
+
+        // R starts and stops recordings; a stopped one is reported once its last readbacks are in
+        if (recording && (!viewer.recording || recording->directory != viewer.recordDir)) {
+            frameCapture.flush();
+            reportRecording(*recording);
+            recording = nullptr;
+        }
+        if (viewer.recording && !recording) {
+            recording = std::make_shared<CaptureSequence>();
+            recording->directory = viewer.recordDir;
+        }
+
+        // The window's pixels before the HUD goes on top; the readback lands a few frames later
+        if (viewer.screenshotRequested || recording) {
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+            if (viewer.screenshotRequested) {
+                std::string path = "screenshot-" + std::to_string(++viewer.screenshotCount) + ".png";
+                frameCapture.capture(params.width, params.height, path);
+                std::cout << "Saving " << path << std::endl;
+                viewer.screenshotRequested = false;
+            }
+            // Fast deflate, so the encoders keep up with 60 fps
+            if (recording) frameCapture.capture(params.width, params.height, recording, 1);
+        }
+        frameCapture.poll();
+        frameTimer.endFrame();
 
-        glfwSwapBuffers(window);
+        FrameStats stats;
+        while (frameTimer.poll(stats)) {
+            statsLog.write(stats);
+            resolution.addSample(stats);
+            lastStats = stats;
+        }
+        if (viewer.showHud) {
+            glViewport(0, 0, params.width, params.height);
+            drawTimingHud(lastStats, params.width, params.height);
+            double now = glfwGetTime();
+            if (now - lastTitleUpdate > 0.25) {
+                std::string title = "Mandelbrot GPU | " + formatStats(lastStats) +
+                                    " | budget " + std::to_string(params.maxIterations);
+                if (accumulatedFrames > 1) title += " | " + std::to_string(accumulatedFrames) + " samples";
+                if (viewer.useCpu) {
+                    TileScheduler::Stats cpu = cpuRenderer.schedulerStats();
+                    char text[128];
+                    std::snprintf(text, sizeof(text), " | %d threads %.1f%% busy, tail %.2f ms",
+                                  cpuRenderer.threadCount(), cpu.utilization * 100.0, cpu.tailMs);
+                    title += text;
+                }
+                glfwSetWindowTitle(window, title.c_str());
+                lastTitleUpdate = now;
+            }
+            hudTitleShown = true;
+        } else if (hudTitleShown) {
+            glfwSetWindowTitle(window, "Mandelbrot GPU");
+            hudTitleShown = false;
+        }
+
+        {
+            TRACE_SCOPE("swapBuffers");
+            glfwSwapBuffers(window);
+        }
+
+        // Spend idle frames building the variant a contrast switch would need;
+        // palettes are textures and switch without a rebuild
+        if (!isMoving) {
+            for (int i = 0; i < 2; i++) {
+                VariantKey key = {i == 1, perturb, viewer.useCompute && params.histogram,
+                                  viewer.useCompute && params.supersample, params.distanceEstimate};
+                if (!programs.has(key)) {
+                    TRACE_SCOPE("buildVariant", "index", key.index());
+                    programs.get(key);
+                    break;
+                }
+            }
+        }
         
         if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
             glfwSetWindowShouldClose(window, true);
+        traceFlush();
     }
-    
+    traceStop();
+
+    // Workers may still be writing into the mapped buffers
+    cpuRenderer.stop();
+    tileStream.destroy();
+    frameCapture.destroy();
+    if (recording) reportRecording(*recording);
+    if (frameCapture.dropped() > 0)
+        std::cerr << "Dropped " << frameCapture.dropped() << " screenshots the encoders fell behind on" << std::endl;
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
     glDeleteFramebuffers(1, &fbo);
     glDeleteTextures(1, &fboTexture);
-    glDeleteProgram(shaderProgram);
+    glDeleteFramebuffers(1, &accumFbo);
+    glDeleteTextures(1, &accumTexture);
+    glDeleteProgram(accumulateProgram);
+    glDeleteTextures(1, &orbitTexture);
+    glDeleteBuffers(1, &orbitBuffer);
+    glDeleteTextures(1, &paletteTexture);
+    glDeleteBuffers(1, &viewStateBuffer);
+    frameTimer.destroy();
+    fragmentPrograms.destroy();
+    colorizePrograms.destroy();
+    computePasses.destroy();
     
     glfwTerminate();
     return 0;
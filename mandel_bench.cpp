@@ -0,0 +1,500 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "colorize.h"
+#include "cpu_renderer.h"
+#include "gl_renderer.h"
+#include "image_io.h"
+#include "iteration_report.h"
+#include "orbit.h"
+#include "renderer.h"
+
+// Throughput of every render engine over a fixed set of views, in the spirit of
+// Google Benchmark: each engine renders each view to RGB repeatedly until
+// --min-time has passed, and the mean frame gives Mpixel/s, Giter/s,
+// ns/iteration and C++ heap allocations per frame. The -aa engines add
+// adaptive supersampling; their rates count the base image's iterations only,
+// so the drop against the plain engine is the cost of the refinement. The -de
+// engines add distance estimation, which iterates dz/dc alongside z; their
+// rates likewise count iterations of z, so the drop is the derivative's cost.
+//
+// Every engine is credited with the iterations the threaded engine needs, after
+// periodicity detection and interior discs have cut the interior short. The
+// shader kernels iterate the interior in full, so on interior-heavy views their
+// Giter/s reads as the useful work done per second, not the raw rate.
+//
+// With --check-golden the same views are rendered once per engine instead and
+// the smooth iteration counts are compared against the golden buffers stored in
+// golden/, so a change to any engine that alters its output shows up as
+// mismatching pixels. --update-golden rewrites them from the scalar engine.
+//
+// --export writes each view's image with its iteration heatmap, raw counts and
+// histogram, and prints where the iterations went.
+
+// Every operator new in the process goes through here, worker threads included
+static std::atomic<uint64_t> allocationCount{0};
+static std::atomic<uint64_t> allocationBytes{0};
+
+void* operator new(size_t size) {
+    allocationCount++;
+    allocationBytes += size;
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+
+namespace {
+
+struct BenchView {
+    const char* name;
+    double centerX, centerY;
+    double zoom;
+    int maxIterations;
+};
+
+// Every engine colors with the first built-in palette, so results don't depend on palette files
+const Palette benchPalette = builtinPalettes()[0];
+
+const BenchView views[] = {
+    {"default", -0.5, 0.0, 2.0, 256},
+    {"seahorse", -0.745, 0.11, 0.02, 1000},             // boundary detail, few interior points
+    {"interior", -0.3, 0.2, 1.3, 1000},                 // more than half the pixels run to maxIterations
+    {"zoom-1e-12", -0.7436438870371, 0.1318259042053, 1e-12, 4000},
+    {"deep", -1.7497219, 0.0, 1e-14, 8000},             // perturbation near the real axis
+};
+
+// Every engine the benchmark can run, and what it needs. --filter matches
+// against these names, so the selection checks below all come from this list.
+enum class Backend { Cpu, Gl, GlCompute };
+
+struct BenchEngine {
+    const char* name;
+    Backend backend;
+};
+
+const BenchEngine engines[] = {
+    {"scalar", Backend::Cpu},
+    {"threaded", Backend::Cpu},
+    {"threaded-aa", Backend::Cpu},
+    {"threaded-de", Backend::Cpu},
+    {"shader-fragment", Backend::Gl},
+    {"shader-fragment-de", Backend::Gl},
+    {"shader-compute", Backend::GlCompute},
+    {"shader-compute-aa", Backend::GlCompute},
+    {"shader-compute-de", Backend::GlCompute},
+};
+
+struct Options {
+    int width = 400, height = 300;
+    int threads = 0;
+    double minTime = 0.5;
+    std::string filter;
+    std::string jsonPath;
+    bool gl = true;
+    std::string checkGolden, updateGolden, exportDir;  // directories
+    // A pixel matches its golden value within tolerance + relativeTolerance * golden
+    double tolerance = 0.01, relativeTolerance = 1e-4;
+    // Percent of pixels per engine and view. The shaders round differently from
+    // the CPU and a few boundary pixels escape at another iteration.
+    double maxMismatch = 0.25;
+};
+
+// One view as every engine sees it, set up outside the timed region
+struct Scene {
+    const BenchView* view = nullptr;
+    ViewParams params;
+    CpuView cpuView;
+    uint64_t iterations = 0;  // per frame, counted once by the threaded engine
+};
+
+struct Result {
+    std::string engine, view;
+    int frames = 0;
+    double meanMs = 0.0, minMs = 0.0;
+    uint64_t iterations = 0;
+    double allocations = 0.0, allocatedBytes = 0.0;  // per frame
+};
+
+double msSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// One untimed warm-up frame, then frames until minTime has passed
+Result measure(const std::string& engine, const Scene& scene, double minTime, const std::function<void()>& frame) {
+    frame();
+
+    Result result;
+    result.engine = engine;
+    result.view = scene.view->name;
+    result.iterations = scene.iterations;
+    result.minMs = 1e300;
+    double totalMs = 0.0;
+    uint64_t allocationsBefore = allocationCount, bytesBefore = allocationBytes;
+    while (result.frames == 0 || totalMs < minTime * 1000.0) {
+        auto start = std::chrono::steady_clock::now();
+        frame();
+        double ms = msSince(start);
+        result.minMs = std::min(result.minMs, ms);
+        totalMs += ms;
+        result.frames++;
+    }
+    result.meanMs = totalMs / result.frames;
+    result.allocations = (double)(allocationCount - allocationsBefore) / result.frames;
+    result.allocatedBytes = (double)(allocationBytes - bytesBefore) / result.frames;
+    return result;
+}
+
+// Single thread, pixel by pixel, colored row by row: the baseline the other engines are measured against
+uint64_t renderScalar(const CpuView& view, Colorizer colorize, std::vector<float>& mu, std::vector<uint8_t>& rgb) {
+    mu.resize((size_t)view.width * view.height);
+    rgb.resize(mu.size() * 3);
+    uint64_t total = 0;
+    for (int y = 0; y < view.height; y++) {
+        size_t row = (size_t)y * view.width;
+        for (int x = 0; x < view.width; x++) {
+            int iterations;
+            mu[row + x] = getIterations(view, x, y, iterations);
+            total += iterations;
+        }
+        colorize(&mu[row], view.width, view.maxIterations, view.zoom, &rgb[row * 3]);
+    }
+    return total;
+}
+
+std::string jsonString(const std::string& text) {
+    std::string quoted = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') quoted += '\\';
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+bool writeJson(const std::string& path, const Options& options, int threads, const std::string& glRenderer,
+               const std::vector<Result>& results) {
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "Failed to open " << path << std::endl;
+        return false;
+    }
+    char line[512];
+    out << "{\n  \"context\": {\n";
+    std::snprintf(line, sizeof(line), "    \"width\": %d,\n    \"height\": %d,\n    \"threads\": %d,\n    \"min_time\": %g,\n",
+                  options.width, options.height, threads, options.minTime);
+    out << line;
+    out << "    \"gl_renderer\": " << jsonString(glRenderer) << "\n  },\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        double pixels = (double)options.width * options.height;
+        out << "    {\n      \"name\": " << jsonString(r.engine + "/" + r.view) << ",\n";
+        out << "      \"engine\": " << jsonString(r.engine) << ",\n      \"view\": " << jsonString(r.view) << ",\n";
+        std::snprintf(line, sizeof(line),
+                      "      \"frames\": %d,\n      \"mean_ms\": %.4f,\n      \"min_ms\": %.4f,\n"
+                      "      \"iterations\": %llu,\n      \"mpixels_per_second\": %.4f,\n"
+                      "      \"giterations_per_second\": %.4f,\n      \"ns_per_iteration\": %.4f,\n"
+                      "      \"allocations_per_frame\": %.2f,\n      \"allocated_bytes_per_frame\": %.1f\n",
+                      r.frames, r.meanMs, r.minMs, (unsigned long long)r.iterations,
+                      pixels / (r.meanMs * 1e3), r.iterations / (r.meanMs * 1e6),
+                      r.meanMs * 1e6 / std::max<uint64_t>(r.iterations, 1), r.allocations, r.allocatedBytes);
+        out << line << "    }" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+    return true;
+}
+
+void printResult(const Result& r, const Options& options) {
+    double pixels = (double)options.width * options.height;
+    std::printf("%-26s %6d %10.3f %10.2f %9.3f %9.3f %10.1f\n", (r.engine + "/" + r.view).c_str(), r.frames,
+                r.meanMs, pixels / (r.meanMs * 1e3), r.iterations / (r.meanMs * 1e6),
+                r.meanMs * 1e6 / std::max<uint64_t>(r.iterations, 1), r.allocations);
+    std::fflush(stdout);
+}
+
+
+Scene makeScene(const BenchView& view, int width, int height) {
+    ViewParams params;
+    params.centerX = view.centerX;
+    params.centerY = view.centerY;
+    params.zoom = view.zoom;
+    params.width = width;
+    params.height = height;
+    params.maxIterations = view.maxIterations;
+    Scene scene;
+    scene.view = &view;
+    scene.params = params;
+    scene.cpuView = cpuView(params);
+    if (params.perturbed()) {
+        scene.cpuView.orbit = std::make_shared<ReferenceOrbit>(
+            computeReferenceOrbit(view.centerX, view.centerY, view.maxIterations));
+    }
+    return scene;
+}
+
+// Golden buffers are PFM files, one per view
+std::string goldenPath(const std::string& directory, const BenchView& view) {
+    return directory + "/" + view.name + ".pfm";
+}
+
+// Percentage of pixels outside tolerance; interior against exterior always counts
+double mismatchPercent(const std::vector<float>& mu, const std::vector<float>& golden, int maxIterations,
+                       const Options& options, double& worst) {
+    size_t mismatches = 0;
+    worst = 0.0;
+    for (size_t i = 0; i < golden.size(); i++) {
+        bool interior = mu[i] >= (float)maxIterations, goldenInterior = golden[i] >= (float)maxIterations;
+        double difference = std::fabs((double)mu[i] - golden[i]);
+        if (std::isnan(difference)) difference = INFINITY;
+        worst = std::max(worst, difference);
+        if (interior != goldenInterior || difference > options.tolerance + options.relativeTolerance * std::fabs(golden[i]))
+            mismatches++;
+    }
+    return 100.0 * mismatches / std::max<size_t>(golden.size(), 1);
+}
+
+int runGolden(Options options) {
+    bool update = !options.updateGolden.empty();
+    const std::string& directory = update ? options.updateGolden : options.checkGolden;
+
+    // Checks render at the size the golden buffers were made at
+    std::vector<std::vector<float>> goldens(sizeof(views) / sizeof(views[0]));
+    if (!update) {
+        for (size_t v = 0; v < goldens.size(); v++) {
+            int width, height;
+            if (!readPfm(goldenPath(directory, views[v]), width, height, goldens[v])) return 1;
+            if (v > 0 && (width != options.width || height != options.height)) {
+                std::cerr << "Golden buffers in " << directory << " differ in size" << std::endl;
+                return 1;
+            }
+            options.width = width;
+            options.height = height;
+        }
+    }
+
+    // The threaded and compute engines are checked as the Renderer backends the tools render with
+    std::unique_ptr<Renderer> threaded = createCpuRenderer({benchPalette}, options.threads);
+    GlRenderer gl({benchPalette});
+    bool haveGl = !update && options.gl && gl.init(options.width, options.height);
+    if (!update && options.gl && !haveGl) std::cerr << "No OpenGL 4.1 context, skipping the shader engines" << std::endl;
+
+    std::printf("%dx%d, tolerance %g + %g * golden, at most %g%% mismatching pixels\n", options.width, options.height,
+                options.tolerance, options.relativeTolerance, options.maxMismatch);
+    std::printf("%-26s %10s %12s\n", "engine/view", "mismatch", "worst");
+
+    std::vector<float> mu;
+    std::vector<uint8_t> rgb;
+    RenderResult result;
+    Colorizer colorize = {&benchPalette, true};
+    int failures = 0;
+    for (size_t v = 0; v < goldens.size(); v++) {
+        const BenchView& view = views[v];
+        Scene scene = makeScene(view, options.width, options.height);
+        if (update) {
+            renderScalar(scene.cpuView, colorize, mu, rgb);
+            if (!writePfm(goldenPath(directory, view), options.width, options.height, mu.data())) return 1;
+            std::printf("%-26s written\n", view.name);
+            continue;
+        }
+
+        auto compare = [&](const std::string& engine, const std::vector<float>& result) {
+            if (!options.filter.empty() && (engine + "/" + view.name).find(options.filter) == std::string::npos) return;
+            double worst;
+            double percent = mismatchPercent(result, goldens[v], view.maxIterations, options, worst);
+            bool pass = percent <= options.maxMismatch;
+            std::printf("%-26s %9.4f%% %12.4g %s\n", (engine + "/" + view.name).c_str(), percent, worst, pass ? "ok" : "FAIL");
+            std::fflush(stdout);
+            if (!pass) failures++;
+        };
+
+        auto compareRender = [&](const std::string& engine, Renderer& renderer) {
+            if (renderer.render(scene.params, result)) compare(engine, result.mu);
+            else failures++;
+        };
+
+        renderScalar(scene.cpuView, colorize, mu, rgb);
+        compare("scalar", mu);
+        compareRender("threaded", *threaded);
+        if (haveGl) {
+            gl.prepare(scene.cpuView);
+            gl.fragmentIterations(mu);
+            compare("shader-fragment", mu);
+            if (gl.hasCompute()) compareRender("shader-compute", gl);
+        }
+    }
+
+    if (failures) std::printf("%d engine/view pairs differ from the golden buffers\n", failures);
+    return failures ? 1 : 0;
+}
+
+int runExport(const Options& options) {
+    CpuRenderer threaded(options.threads);
+    Colorizer colorize = {&benchPalette, true};
+    for (const BenchView& view : views) {
+        if (!options.filter.empty() && std::string(view.name).find(options.filter) == std::string::npos) continue;
+        Scene scene = makeScene(view, options.width, options.height);
+        threaded.render(scene.cpuView, colorize);
+        IterationReport report;
+        if (!exportIterationReport(options.exportDir + "/" + view.name, options.width, options.height,
+                                   view.maxIterations, threaded.counts().data(),
+                                   threaded.iterations().data(), threaded.pixels().data(), report))
+            return 1;
+        std::printf("%-12s %s\n", view.name, formatReport(report).c_str());
+    }
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--size" && i + 1 < argc && std::sscanf(argv[i + 1], "%dx%d", &options.width, &options.height) == 2) {
+            i++;
+        } else if (arg == "--threads" && i + 1 < argc) {
+            options.threads = std::atoi(argv[++i]);
+        } else if (arg == "--min-time" && i + 1 < argc) {
+            options.minTime = std::atof(argv[++i]);
+        } else if (arg == "--filter" && i + 1 < argc) {
+            options.filter = argv[++i];
+        } else if (arg == "--json" && i + 1 < argc) {
+            options.jsonPath = argv[++i];
+        } else if (arg == "--no-gl") {
+            options.gl = false;
+        } else if (arg == "--check-golden" && i + 1 < argc) {
+            options.checkGolden = argv[++i];
+        } else if (arg == "--update-golden" && i + 1 < argc) {
+            options.updateGolden = argv[++i];
+        } else if (arg == "--export" && i + 1 < argc) {
+            options.exportDir = argv[++i];
+        } else if (arg == "--tolerance" && i + 1 < argc) {
+            options.tolerance = std::atof(argv[++i]);
+        } else if (arg == "--max-mismatch" && i + 1 < argc) {
+            options.maxMismatch = std::atof(argv[++i]);
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--size WxH] [--threads N] [--min-time seconds]"
+                      << " [--filter substring] [--json file] [--no-gl]\n"
+                      << "       " << argv[0] << " --check-golden dir [--tolerance t] [--max-mismatch percent]"
+                      << " [--filter substring] [--no-gl]\n"
+                      << "       " << argv[0] << " --update-golden dir [--size WxH]\n"
+                      << "       " << argv[0] << " --export dir [--size WxH] [--filter substring]" << std::endl;
+            return -1;
+        }
+    }
+    if (options.width <= 0 || options.height <= 0) {
+        std::cerr << "Invalid --size" << std::endl;
+        return -1;
+    }
+    if (!options.checkGolden.empty() || !options.updateGolden.empty()) return runGolden(options);
+    if (!options.exportDir.empty()) return runExport(options);
+
+    CpuRenderer threaded(options.threads);
+    GlRenderer gl({benchPalette});
+    std::string glRenderer = "none";
+    if (options.gl) {
+        if (gl.init(options.width, options.height)) glRenderer = gl.deviceName();
+        else std::cerr << "No OpenGL 4.1 context, skipping the shader engines" << std::endl;
+    }
+    bool haveGl = glRenderer != "none";
+
+    std::printf("%dx%d, %d threads, GL: %s\n", options.width, options.height, threaded.threadCount(), glRenderer.c_str());
+    std::printf("%-26s %6s %10s %10s %9s %9s %10s\n", "benchmark", "frames", "ms/frame", "Mpixel/s", "Giter/s",
+                "ns/iter", "allocs");
+
+    Colorizer colorize = {&benchPalette, true};
+    std::vector<float> mu;
+    std::vector<uint8_t> rgb;
+    std::vector<Result> results;
+    for (const BenchView& view : views) {
+        auto available = [&](Backend backend) {
+            return backend == Backend::Cpu || (haveGl && (backend == Backend::Gl || gl.hasCompute()));
+        };
+        // Engines this run renders the view with, by name
+        std::set<std::string> runs;
+        for (const BenchEngine& engine : engines) {
+            if (available(engine.backend)
+                && (options.filter.empty() || (std::string(engine.name) + "/" + view.name).find(options.filter) != std::string::npos))
+                runs.insert(engine.name);
+        }
+        if (runs.empty()) continue;
+        auto selected = [&](const char* engine) { return runs.count(engine) != 0; };
+        bool anyGl = std::any_of(std::begin(engines), std::end(engines), [&](const BenchEngine& engine) {
+            return engine.backend != Backend::Cpu && selected(engine.name);
+        });
+
+        Scene scene = makeScene(view, options.width, options.height);
+        // Counted once, by the engine that skips the most
+        scene.iterations = threaded.render(scene.cpuView, colorize);
+
+        if (selected("scalar")) {
+            results.push_back(measure("scalar", scene, options.minTime, [&] {
+                renderScalar(scene.cpuView, colorize, mu, rgb);
+            }));
+            printResult(results.back(), options);
+        }
+        if (selected("threaded")) {
+            results.push_back(measure("threaded", scene, options.minTime, [&] {
+                threaded.render(scene.cpuView, colorize);
+            }));
+            printResult(results.back(), options);
+        }
+        if (selected("threaded-aa")) {
+            results.push_back(measure("threaded-aa", scene, options.minTime, [&] {
+                threaded.render(scene.cpuView, colorize, true);
+            }));
+            printResult(results.back(), options);
+        }
+        if (selected("threaded-de")) {
+            CpuView distanceView = scene.cpuView;
+            distanceView.distanceEstimate = true;
+            results.push_back(measure("threaded-de", scene, options.minTime, [&] {
+                threaded.render(distanceView, colorize);
+            }));
+            printResult(results.back(), options);
+        }
+        if (anyGl) {
+            gl.prepare(scene.cpuView);
+            if (selected("shader-fragment")) {
+                results.push_back(measure("shader-fragment", scene, options.minTime, [&] { gl.renderFragment(); }));
+                printResult(results.back(), options);
+            }
+            if (selected("shader-fragment-de")) {
+                results.push_back(measure("shader-fragment-de", scene, options.minTime, [&] { gl.renderFragment(true); }));
+                printResult(results.back(), options);
+            }
+            if (selected("shader-compute")) {
+                results.push_back(measure("shader-compute", scene, options.minTime, [&] { gl.renderCompute(); }));
+                printResult(results.back(), options);
+            }
+            if (selected("shader-compute-aa")) {
+                results.push_back(measure("shader-compute-aa", scene, options.minTime, [&] { gl.renderCompute(true); }));
+                printResult(results.back(), options);
+            }
+            if (selected("shader-compute-de")) {
+                results.push_back(measure("shader-compute-de", scene, options.minTime, [&] {
+                    gl.renderCompute(false, true);
+                }));
+                printResult(results.back(), options);
+            }
+        }
+    }
+
+    if (!options.jsonPath.empty() && !writeJson(options.jsonPath, options, threaded.threadCount(), glRenderer, results))
+        return 1;
+    return 0;
+}
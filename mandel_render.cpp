@@ -0,0 +1,635 @@
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "tile_protocol.h"
+
+// Renders one large image, such as a poster, on mandel-server workers: local
+// processes, machines reachable over TCP, or both. The image is cut into
+// equal tiles, each requested from a worker as raw RGB and written into the
+// output PPM as soon as it arrives, so the image never has to fit in memory.
+//
+// Tiles are dealt to the workers in contiguous runs, which keeps neighbouring
+// tiles (and their reference orbits) on the same worker. Every worker has
+// --connections requests in flight, each taking tiles from the front of the
+// worker's own run. A worker that runs dry steals from the back of the longest
+// run left, so fast workers end up rendering more of the image. A tile whose
+// request fails, whether the worker answers with an error, drops the
+// connection or sends nothing for --timeout seconds, goes back to be
+// rendered by the next worker, up to --retries times. Workers send a line
+// every 10 seconds while a tile renders, so the timeout only catches workers
+// that hang or vanish, not deep tiles. A connection that fails, the first
+// attempt included, is made once more; a worker that stays unreachable leaves
+// its tiles to be stolen by the others.
+//
+// --spawn N starts N local workers on Unix domain sockets, each with its share
+// of the hardware threads, which is also how the scheme is tested on one
+// machine.
+//
+// Every --checkpoint seconds the tiles finished since the last checkpoint are
+// flushed to the image and listed in <output>.journal. Run the same command
+// again after a crash and it renders only the tiles the journal doesn't list.
+// Each square of anchorTiles x anchorTiles tiles of a deep render shares the
+// reference orbit of its center, so the image is the same however the tiles
+// are dealt and resumed. The workers keep those orbits in their on-disk orbit
+// cache, so a resumed render reuses the orbits of the first run instead of
+// computing them again.
+
+namespace {
+
+struct Options {
+    double centerX = -0.5, centerY = 0.0;
+    double zoom = 3.0;
+    int width = 4096, height = 4096;
+    int maxIterations = 1000;
+    std::string palette = "1";
+    int tileSize = 256;
+    std::vector<std::string> workers;
+    int spawn = 0;
+    int connections = 2;  // per worker
+    int retries = 3;
+    int timeout = 60;  // seconds without a byte from a worker before its tile is retried
+    std::string output = "poster.ppm";
+    int checkpoint = 30;  // seconds between journal entries
+};
+
+// The requests for every tile still to render, and who renders them
+class Dispatcher {
+public:
+    Dispatcher(const std::vector<int>& tiles, int tileCount, int workerCount, int retries)
+        : rendered(workerCount, 0), stolen(workerCount, 0), queues(workerCount), attempts(tileCount, 0),
+          remaining((int)tiles.size()), retries(retries) {
+        for (int w = 0; w < workerCount; w++) {
+            size_t first = tiles.size() * w / workerCount, last = tiles.size() * (w + 1) / workerCount;
+            queues[w].assign(tiles.begin() + first, tiles.begin() + last);
+        }
+    }
+
+    // Next tile for worker, waiting while other requests may still fail and
+    // come back. False once every tile is done or the render has failed.
+    bool take(int worker, int& tile) {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            if (remaining == 0 || failed) return false;
+            if (!queues[worker].empty()) {
+                tile = queues[worker].front();
+                queues[worker].pop_front();
+                return true;
+            }
+            auto victim = std::max_element(queues.begin(), queues.end(),
+                                           [](const std::deque<int>& a, const std::deque<int>& b) {
+                                               return a.size() < b.size();
+                                           });
+            if (!victim->empty()) {
+                tile = victim->back();
+                victim->pop_back();
+                stolen[worker]++;
+                return true;
+            }
+            changed.wait(lock);
+        }
+    }
+
+    void done(int worker) {
+        std::lock_guard<std::mutex> lock(mutex);
+        rendered[worker]++;
+        remaining--;
+        if (remaining == 0) changed.notify_all();
+    }
+
+    // Hands tile to the next worker after a failed attempt on worker, or fails
+    // the whole render once it has used up its retries
+    void retry(int worker, int tile, const std::string& why) {
+        std::lock_guard<std::mutex> lock(mutex);
+        retried++;
+        if (++attempts[tile] > retries) {
+            if (!failed) std::cerr << "Tile " << tile << " failed " << attempts[tile] << " times: " << why << std::endl;
+            failed = true;
+        } else {
+            queues[(worker + 1) % queues.size()].push_front(tile);
+        }
+        changed.notify_all();
+    }
+
+    // A worker whose connections are all gone; if it was the last, nobody is
+    // left to render the remaining tiles
+    void workerLost() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (++lostWorkers == (int)queues.size() && remaining > 0) {
+            std::cerr << "Every worker is unreachable, " << remaining << " tiles left" << std::endl;
+            failed = true;
+        }
+        changed.notify_all();
+    }
+
+    bool succeeded() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return !failed && remaining == 0;
+    }
+    int tilesLeft() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return remaining;
+    }
+
+    // Written once every connection has finished
+    std::vector<int> rendered, stolen;
+    int retried = 0;
+
+private:
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<std::deque<int>> queues;
+    std::vector<int> attempts;
+    int remaining;
+    int retries;
+    int lostWorkers = 0;
+    bool failed = false;
+};
+
+// The output image, written tile by tile at its final place
+class StreamedPpm {
+public:
+    // resume keeps the pixels of an earlier run, if the file is that image
+    bool open(const std::string& path, int width, int height, bool resume = false) {
+        this->width = width;
+        this->height = height;
+        std::string header = "P6\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
+        headerSize = header.size();
+        size_t fileSize = headerSize + (size_t)width * height * 3;
+        if (resume) {
+            fd = ::open(path.c_str(), O_WRONLY);
+            struct stat info;
+            if (fd >= 0 && fstat(fd, &info) == 0 && (size_t)info.st_size == fileSize) return true;
+            std::cerr << "Cannot resume: " << path << " is missing or not the same image" << std::endl;
+            if (fd >= 0) close(fd);
+            fd = -1;
+            return false;
+        }
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            std::cerr << "Failed to open " << path << ": " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        if (!writeAt(header.data(), header.size(), 0) || ftruncate(fd, (off_t)fileSize) != 0) {
+            std::cerr << "Failed to size " << path << ": " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    ~StreamedPpm() {
+        if (fd >= 0) close(fd);
+    }
+
+    // A tile of tileSize x tileSize pixels, rows top-down, whose bottom-left
+    // pixel is (x0, y0) counted from the bottom-left of the image; the parts
+    // outside the image are cropped
+    bool writeTile(const std::vector<uint8_t>& rgb, int tileSize, int x0, int y0) {
+        int columns = std::min(tileSize, width - x0);
+        for (int row = 0; row < tileSize; row++) {
+            int y = y0 + tileSize - 1 - row;
+            if (y >= height) continue;
+            size_t offset = headerSize + ((size_t)(height - 1 - y) * width + x0) * 3;
+            if (!writeAt(&rgb[(size_t)row * tileSize * 3], (size_t)columns * 3, offset)) return false;
+        }
+        return true;
+    }
+
+    // Waits until everything written so far is on disk
+    bool sync() { return fdatasync(fd) == 0; }
+
+private:
+    bool writeAt(const void* data, size_t size, size_t offset) {
+        const char* bytes = (const char*)data;
+        while (size > 0) {
+            ssize_t written = pwrite(fd, bytes, size, (off_t)offset);
+            if (written < 0 && errno == EINTR) continue;
+            if (written <= 0) return false;
+            bytes += written;
+            offset += (size_t)written;
+            size -= (size_t)written;
+        }
+        return true;
+    }
+
+    int fd = -1;
+    int width = 0, height = 0;
+    size_t headerSize = 0;
+};
+
+// The tiles of the output that are finished. The first line holds the render
+// parameters, then every checkpoint appends a line of the tiles finished since
+// the last one, written only after those tiles are on disk. A line cut short
+// by a crash is ignored, and so is a journal for other parameters.
+class RenderJournal {
+public:
+    // Marks the tiles a journal at path lists in done, if it is one for
+    // parameters; returns how many it lists. A journal naming a tile outside
+    // the image is not trusted at all: done is left all false and 0 returned.
+    static int read(const std::string& path, const std::string& parameters, std::vector<bool>& done) {
+        std::ifstream in(path);
+        std::string line;
+        if (!std::getline(in, line) || line != parameters || in.eof()) return 0;
+        int count = 0;
+        while (std::getline(in, line) && !in.eof()) {
+            std::istringstream tiles(line);
+            std::string word;
+            int tile;
+            if (!(tiles >> word) || word != "done") break;
+            while (tiles >> tile) {
+                if (tile < 0 || tile >= (int)done.size()) {
+                    done.assign(done.size(), false);
+                    return 0;
+                }
+                if (!done[tile]) count++;
+                done[tile] = true;
+            }
+        }
+        return count;
+    }
+
+    // Starts the journal at path over with parameters and the tiles in done,
+    // which also drops a line cut short before a resume
+    bool open(const std::string& path, const std::string& parameters, const std::vector<bool>& done) {
+        this->path = path;
+        std::string text = parameters + "\n";
+        if (std::find(done.begin(), done.end(), true) != done.end()) {
+            text += "done";
+            for (size_t tile = 0; tile < done.size(); tile++) {
+                if (done[tile]) text += " " + std::to_string(tile);
+            }
+            text += "\n";
+        }
+        std::string tmpPath = path + ".tmp";
+        fd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+        if (fd < 0 || !append(text) || rename(tmpPath.c_str(), path.c_str()) != 0) {
+            std::cerr << "Failed to write " << path << ": " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    ~RenderJournal() {
+        if (fd >= 0) close(fd);
+    }
+
+    // Called once tile is written to the image
+    void finished(int tile) {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending.push_back(tile);
+    }
+
+    // Gets the tiles finished since the last checkpoint to disk, image first
+    bool checkpoint(StreamedPpm& image) {
+        std::vector<int> tiles;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tiles.swap(pending);
+        }
+        if (tiles.empty()) return true;
+        std::string line = "done";
+        for (int tile : tiles) line += " " + std::to_string(tile);
+        if (!image.sync() || !append(line + "\n")) {
+            std::cerr << "Checkpoint to " << path << " failed: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // The render is complete
+    void remove() {
+        close(fd);
+        fd = -1;
+        unlink(path.c_str());
+    }
+
+private:
+    bool append(const std::string& text) {
+        const char* bytes = text.data();
+        size_t size = text.size();
+        while (size > 0) {
+            ssize_t written = write(fd, bytes, size);
+            if (written < 0 && errno == EINTR) continue;
+            if (written <= 0) return false;
+            bytes += written;
+            size -= (size_t)written;
+        }
+        return fdatasync(fd) == 0;
+    }
+
+    std::string path;
+    int fd = -1;
+    std::mutex mutex;
+    std::vector<int> pending;
+};
+
+// Tiles on a side of the square of tiles that share a reference orbit. The
+// farthest tile center is 1.5 tiles from the square's center on both axes,
+// about 2.1 tile zooms and within the 4 an orbit covers.
+const int anchorTiles = 4;
+
+// Tile index -> the request that renders it. Every tile is the same size, so
+// they all share one zoom, and they are colored for the image's zoom. Deep
+// tiles are anchored at the center of their square of tiles, which fixes every
+// pixel whichever worker renders the tile, in whatever order.
+TileRequest tileRequest(const Options& options, int tilesX, int tile, int& x0, int& y0) {
+    x0 = tile % tilesX * options.tileSize;
+    y0 = tile / tilesX * options.tileSize;
+    double pixel = options.zoom / std::min(options.width, options.height);
+    TileRequest request;
+    request.centerX = options.centerX + (x0 + 0.5 * options.tileSize - 0.5 * options.width) * pixel;
+    request.centerY = options.centerY + (y0 + 0.5 * options.tileSize - 0.5 * options.height) * pixel;
+    request.zoom = pixel * options.tileSize;
+    request.width = request.height = options.tileSize;
+    request.maxIterations = options.maxIterations;
+    request.colorZoom = options.zoom;
+    if (request.view().perturbed()) {
+        int square = anchorTiles * options.tileSize;
+        request.anchored = true;
+        request.anchorX = options.centerX + (x0 / square * square + 0.5 * square - 0.5 * options.width) * pixel;
+        request.anchorY = options.centerY + (y0 / square * square + 0.5 * square - 0.5 * options.height) * pixel;
+    }
+    return request;
+}
+
+int connectWithTimeout(const std::string& address, int timeoutSeconds) {
+    int fd = connectTo(address);
+    if (fd < 0) return -1;
+    timeval timeout = {};
+    timeout.tv_sec = timeoutSeconds;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    return fd;
+}
+
+// One connection to a worker, rendering tiles until there are none left
+void runConnection(const Options& options, const std::string& address, int worker, Dispatcher& dispatcher,
+                   StreamedPpm& image, RenderJournal& journal, std::atomic<int>& liveConnections) {
+    int tilesX = (options.width + options.tileSize - 1) / options.tileSize;
+    size_t tileBytes = (size_t)options.tileSize * options.tileSize * 3;
+    std::vector<uint8_t> rgb(tileBytes);
+    // The connection is made at most twice, so a worker that is slow to start
+    // or drops one connection gets a second chance
+    int fd = -1;
+    int attempts = 0;
+    LineReader reader(fd);
+    auto connect = [&] {
+        if (attempts++ > 0) std::this_thread::sleep_for(std::chrono::seconds(1));
+        fd = connectWithTimeout(address, options.timeout);
+        reader = LineReader(fd);
+        return fd >= 0;
+    };
+    if (!connect()) connect();
+    int tile;
+    while (fd >= 0 && dispatcher.take(worker, tile)) {
+        int x0, y0;
+        TileRequest request = tileRequest(options, tilesX, tile, x0, y0);
+        std::string header;
+        bool connected = sendLine(fd, formatTileRequest(request, options.palette, false)) && reader.readLine(header);
+        // The worker is still rendering a deep tile
+        while (connected && header == "busy") connected = reader.readLine(header);
+        if (connected && header.compare(0, 7, "ok raw ") == 0) {
+            int width = 0, height = 0;
+            size_t bytes = 0;
+            bool valid = std::sscanf(header.c_str(), "ok raw %d %d %zu", &width, &height, &bytes) == 3
+                      && width == options.tileSize && height == options.tileSize && bytes == tileBytes;
+            if (!valid) {
+                std::cerr << address << ": unexpected answer " << header << std::endl;
+                connected = false;
+            } else if (reader.read(rgb.data(), rgb.size())) {
+                if (!image.writeTile(rgb, options.tileSize, x0, y0)) {
+                    std::cerr << "Failed to write tile " << tile << ": " << std::strerror(errno) << std::endl;
+                    dispatcher.retry(worker, tile, "write failed");
+                    continue;
+                }
+                journal.finished(tile);
+                dispatcher.done(worker);
+                continue;
+            } else {
+                connected = false;
+            }
+        }
+        if (connected) {
+            // The worker answered with an error; the connection itself is fine
+            dispatcher.retry(worker, tile, header);
+            continue;
+        }
+        dispatcher.retry(worker, tile, address + " dropped the connection");
+        close(fd);
+        fd = -1;
+        if (attempts < 2) connect();
+    }
+    if (fd >= 0) close(fd);
+    else std::cerr << "Giving up on a connection to " << address << std::endl;
+    if (--liveConnections == 0) dispatcher.workerLost();
+}
+
+// Starts count mandel-server processes next to this executable, on abstract
+// Unix sockets that vanish with them; returns their addresses, with pids for
+// stopping them. The workers get SIGTERM when this process dies, however it
+// dies, so a crashed render leaves nothing running behind.
+std::vector<std::string> spawnWorkers(int count, std::vector<pid_t>& pids) {
+    char self[4096];
+    ssize_t length = readlink("/proc/self/exe", self, sizeof(self) - 1);
+    std::string server = "mandel-server";
+    if (length > 0) {
+        std::string path(self, (size_t)length);
+        server = path.substr(0, path.find_last_of('/') + 1) + server;
+    }
+    unsigned hardware = std::max(1u, std::thread::hardware_concurrency());
+    std::string threads = std::to_string(std::max(1u, hardware / (unsigned)count));
+    pid_t parent = getpid();
+    std::vector<std::string> addresses;
+    for (int i = 0; i < count; i++) {
+        std::string address = "@mandel-render-" + std::to_string(parent) + "-worker-" + std::to_string(i);
+        pid_t pid = fork();
+        if (pid == 0) {
+            // The parent may have died before the signal was asked for
+            if (prctl(PR_SET_PDEATHSIG, SIGTERM) != 0 || getppid() != parent) _exit(1);
+            // Workers talk to us, not the terminal
+            int null = ::open("/dev/null", O_WRONLY);
+            if (null >= 0) dup2(null, STDOUT_FILENO);
+            execl(server.c_str(), server.c_str(), "--socket", address.c_str(), "--threads", threads.c_str(),
+                  "--cache", "0", (char*)nullptr);
+            std::cerr << "Failed to start " << server << ": " << std::strerror(errno) << std::endl;
+            _exit(127);
+        }
+        if (pid < 0) {
+            std::cerr << "fork failed: " << std::strerror(errno) << std::endl;
+            break;
+        }
+        pids.push_back(pid);
+        addresses.push_back(address);
+    }
+    // Ready once their sockets accept connections
+    for (const std::string& address : addresses) {
+        for (int wait = 0; wait < 100 && !acceptsConnections(address); wait++)
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    return addresses;
+}
+
+void stopWorkers(const std::vector<pid_t>& pids) {
+    for (pid_t pid : pids) kill(pid, SIGTERM);
+    for (pid_t pid : pids) waitpid(pid, nullptr, 0);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--center" && i + 2 < argc) {
+            options.centerX = std::strtod(argv[++i], nullptr);
+            options.centerY = std::strtod(argv[++i], nullptr);
+        } else if (arg == "--zoom" && i + 1 < argc) {
+            options.zoom = std::strtod(argv[++i], nullptr);
+        } else if (arg == "--size" && i + 1 < argc && std::sscanf(argv[i + 1], "%dx%d", &options.width, &options.height) == 2) {
+            i++;
+        } else if (arg == "--iterations" && i + 1 < argc) {
+            options.maxIterations = std::atoi(argv[++i]);
+        } else if (arg == "--palette" && i + 1 < argc) {
+            options.palette = argv[++i];
+        } else if (arg == "--tile" && i + 1 < argc) {
+            options.tileSize = std::atoi(argv[++i]);
+        } else if (arg == "--worker" && i + 1 < argc) {
+            options.workers.push_back(argv[++i]);
+        } else if (arg == "--spawn" && i + 1 < argc) {
+            options.spawn = std::atoi(argv[++i]);
+        } else if (arg == "--connections" && i + 1 < argc) {
+            options.connections = std::atoi(argv[++i]);
+        } else if (arg == "--retries" && i + 1 < argc) {
+            options.retries = std::atoi(argv[++i]);
+        } else if (arg == "--timeout" && i + 1 < argc) {
+            options.timeout = std::atoi(argv[++i]);
+        } else if (arg == "--output" && i + 1 < argc) {
+            options.output = argv[++i];
+        } else if (arg == "--checkpoint" && i + 1 < argc) {
+            options.checkpoint = std::atoi(argv[++i]);
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--center x y] [--zoom z] [--size WxH] [--iterations N]"
+                      << " [--palette number|name] [--tile pixels] [--output file.ppm] [--checkpoint seconds]\n"
+                      << "       " << std::string(std::strlen(argv[0]), ' ')
+                      << " [--worker path|host:port]... [--spawn N] [--connections N] [--retries N] [--timeout seconds]"
+                      << std::endl;
+            return -1;
+        }
+    }
+    if (options.width <= 0 || options.height <= 0 || !(options.zoom > 0.0) || options.tileSize <= 0
+        || options.tileSize > maxTileSize || options.maxIterations <= 0 || options.connections <= 0
+        || options.checkpoint <= 0) {
+        std::cerr << "Invalid render parameters" << std::endl;
+        return -1;
+    }
+
+    std::vector<pid_t> spawned;
+    if (options.spawn > 0) {
+        for (const std::string& address : spawnWorkers(options.spawn, spawned)) options.workers.push_back(address);
+    }
+    if (options.workers.empty()) {
+        std::cerr << "No workers; give --worker or --spawn" << std::endl;
+        return -1;
+    }
+
+    int tilesX = (options.width + options.tileSize - 1) / options.tileSize;
+    int tilesY = (options.height + options.tileSize - 1) / options.tileSize;
+    int tileCount = tilesX * tilesY;
+    // The version changes with how tiles are rendered; version 1 tiles picked
+    // their own reference orbits and don't match anchored ones
+    char parameters[512];
+    std::snprintf(parameters, sizeof(parameters), "mandel-render 2 %a %a %a %dx%d %d %d %s", options.centerX,
+                  options.centerY, options.zoom, options.width, options.height, options.maxIterations,
+                  options.tileSize, options.palette.c_str());
+    std::string journalPath = options.output + ".journal";
+    std::vector<bool> done(tileCount, false);
+    int resumed = RenderJournal::read(journalPath, parameters, done);
+    StreamedPpm image;
+    if (resumed > 0 && !image.open(options.output, options.width, options.height, true)) resumed = 0;
+    // A fresh render truncates the image, so nothing in it counts as done
+    if (resumed == 0) done.assign(tileCount, false);
+    RenderJournal journal;
+    if ((resumed == 0 && !image.open(options.output, options.width, options.height))
+        || !journal.open(journalPath, parameters, done)) {
+        stopWorkers(spawned);
+        return 1;
+    }
+    std::vector<int> tiles;
+    for (int tile = 0; tile < tileCount; tile++) {
+        if (!done[tile]) tiles.push_back(tile);
+    }
+    int workerCount = (int)options.workers.size();
+    Dispatcher dispatcher(tiles, tileCount, workerCount, options.retries);
+    std::printf("%dx%d in %d tiles of %d pixels on %d workers\n", options.width, options.height, tileCount,
+                options.tileSize, workerCount);
+    if (resumed > 0) std::printf("Resuming from %s: %d tiles already done\n", journalPath.c_str(), resumed);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::atomic<int>> liveConnections(workerCount);
+    std::vector<std::thread> connections;
+    for (int w = 0; w < workerCount; w++) {
+        liveConnections[w] = options.connections;
+        for (int c = 0; c < options.connections; c++) {
+            connections.emplace_back(runConnection, std::cref(options), std::cref(options.workers[w]), w,
+                                     std::ref(dispatcher), std::ref(image), std::ref(journal),
+                                     std::ref(liveConnections[w]));
+        }
+    }
+
+    std::mutex checkpointMutex;
+    std::condition_variable checkpointWake;
+    bool rendering = true;
+    std::thread checkpoints([&] {
+        std::unique_lock<std::mutex> lock(checkpointMutex);
+        while (!checkpointWake.wait_for(lock, std::chrono::seconds(options.checkpoint), [&] { return !rendering; }))
+            journal.checkpoint(image);
+    });
+    for (std::thread& connection : connections) connection.join();
+    {
+        std::lock_guard<std::mutex> lock(checkpointMutex);
+        rendering = false;
+    }
+    checkpointWake.notify_one();
+    checkpoints.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    stopWorkers(spawned);
+
+    for (int w = 0; w < workerCount; w++) {
+        std::printf("  %-32s %6d tiles, %d stolen\n", options.workers[w].c_str(), dispatcher.rendered[w],
+                    dispatcher.stolen[w]);
+    }
+    if (!dispatcher.succeeded()) {
+        journal.checkpoint(image);
+        std::fprintf(stderr, "Render failed with %d tiles left; run again to resume from %s\n",
+                     dispatcher.tilesLeft(), journalPath.c_str());
+        return 1;
+    }
+    journal.remove();
+    double pixels = (double)tiles.size() * options.tileSize * options.tileSize;
+    std::printf("%s in %.2f s (%.1f Mpixel/s), %d retries\n", options.output.c_str(), seconds,
+                pixels / seconds * 1e-6, dispatcher.retried);
+    return 0;
+}
@@ -0,0 +1,563 @@
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "colorize.h"
+#include "cpu_kernel.h"
+#include "image_io.h"
+#include "orbit.h"
+#include "tile_protocol.h"
+#include "tile_scheduler.h"
+
+// Renders tiles on request for the web front end and the mandel-render
+// coordinator, over a Unix domain socket or TCP. A client sends one request
+// per line:
+//
+//     tile <centerX> <centerY> <zoom> <width> <height> <maxIterations> <palette> <raw|png> [colorZoom [anchorX anchorY]]
+//
+// The view is given as in the viewer: zoom is the extent of the shorter side.
+// Coordinates may be decimal (%.17g round-trips) or hex floats, and the palette
+// is its number in the viewer or its name. Colors are contrast enhanced for
+// colorZoom, by default zoom; a tile of a larger image passes the image's.
+// Deep tiles are rendered against a reference orbit, by default any cached one
+// that covers the tile; a tile that gives an anchor, no more than 4 zooms from
+// its center, is rendered against the orbit of that point, so its pixels do not
+// depend on what the server rendered before.
+// Every request gets a one-line header, followed by the tile for "ok":
+//
+//     ok raw <width> <height> <bytes>    RGB8, rows top-down
+//     ok png <width> <height> <bytes>
+//     error <message>
+//
+// A tile that takes longer than 10 seconds is preceded by a "busy" line every
+// 10 seconds until its header, which clients skip; a client can then give up
+// on a server it hasn't heard from in a while without giving up on deep tiles.
+//
+// "stats" answers with one line of counters.
+//
+// Each connection is served by its own thread, one request at a time, and the
+// requests of all connections meet in one queue; connections beyond
+// --max-connections get "error too many connections" and are closed. The
+// render thread takes what is queued, up to a bound on the pixels in flight,
+// and runs the blocks of the whole batch on one TileScheduler, so a burst of
+// small tiles keeps every worker busy. The reference orbits the batch lacks
+// are computed on the scheduler too, side by side. A request
+// identical to one already queued or rendering waits for that render instead of
+// starting its own, and finished tiles stay in an LRU cache for repeats. The
+// cache is bounded by the bytes its tiles hold, PNGs included, and the
+// reference orbits of deep tiles go to an on-disk cache with a size limit of
+// its own (--orbit-cache, --orbit-cache-mb).
+
+namespace {
+
+// Work unit of a batch; a 256x256 tile is 64 of them
+const int blockSize = 32;
+
+// Pixels a batch takes from the queue, 64 tiles of 256x256. Each one holds
+// 11 bytes while it renders, so this bounds the memory of a batch (a single
+// larger tile still goes alone) and leaves the rest queued.
+const size_t batchPixels = 1 << 22;
+
+// How often a client waiting on a render hears that the server is alive
+const std::chrono::seconds keepaliveInterval(10);
+
+// A finished tile in the engines' layout, rows bottom-up. The PNG is encoded
+// the first time a client asks for one.
+struct RenderedTile {
+    int width = 0, height = 0;
+    std::vector<uint8_t> rgb;
+
+    const std::vector<uint8_t>& encodedPng() const {
+        std::call_once(pngOnce, [this] {
+            if (!encodePng(width, height, rgb.data(), png)) png.clear();
+            pngBytes = png.size();
+        });
+        return png;
+    }
+
+    // What the tile holds in memory, safe to ask while the PNG is being encoded
+    size_t bytes() const { return rgb.size() + pngBytes; }
+
+private:
+    mutable std::once_flag pngOnce;
+    mutable std::vector<uint8_t> png;
+    mutable std::atomic<size_t> pngBytes{0};
+};
+
+using TilePtr = std::shared_ptr<const RenderedTile>;
+using OrbitPtr = std::shared_ptr<const ReferenceOrbit>;
+
+class TileServer {
+public:
+    TileServer(std::vector<Palette> palettes, int threadCount, size_t cacheLimit, OrbitCache orbits)
+        : palettes(std::move(palettes)), scheduler(threadCount), orbits(std::move(orbits)), cacheLimit(cacheLimit),
+          renderThread(&TileServer::renderLoop, this) {}
+
+    ~TileServer() { stop(); }
+
+    // Finishes the batch being rendered; requests still queued get null
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping) return;
+            stopping = true;
+        }
+        wake.notify_one();
+        renderThread.join();
+        std::deque<Pending> dropped;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            dropped.swap(queue);
+        }
+        for (Pending& pending : dropped) pending.promise.set_value(nullptr);
+    }
+
+    const std::vector<Palette>& paletteList() const { return palettes; }
+    int threadCount() const { return scheduler.threadCount(); }
+
+    // The tile once it is rendered, at once if it is cached. Null if the
+    // server stopped first.
+    std::shared_future<TilePtr> get(const TileRequest& request) {
+        std::lock_guard<std::mutex> lock(mutex);
+        requests++;
+        auto cached = cacheIndex.find(request);
+        if (cached != cacheIndex.end()) {
+            cacheHits++;
+            cache.splice(cache.begin(), cache, cached->second);
+            return ready(cached->second->tile);
+        }
+        if (stopping) return ready(nullptr);
+        auto running = inFlight.find(request);
+        if (running != inFlight.end()) {
+            deduplicated++;
+            return running->second;
+        }
+        Pending pending;
+        pending.request = request;
+        std::shared_future<TilePtr> result = pending.promise.get_future().share();
+        inFlight.emplace(request, result);
+        queue.push_back(std::move(pending));
+        wake.notify_one();
+        return result;
+    }
+
+    // Updates the cache's account of a tile that has grown since it was cached,
+    // which is when its PNG is encoded
+    void recharge(const TileRequest& request) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto cached = cacheIndex.find(request);
+        if (cached == cacheIndex.end()) return;
+        CacheEntry& entry = *cached->second;
+        size_t bytes = entry.tile->bytes();
+        cacheBytes += bytes - entry.bytes;
+        entry.bytes = bytes;
+        evict();
+    }
+
+    std::string stats() {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::ostringstream out;
+        out << "requests " << requests << " cache-hits " << cacheHits << " deduplicated " << deduplicated
+            << " rendered " << rendered << " batches " << batches << " cached " << cache.size()
+            << " cached-bytes " << cacheBytes;
+        return out.str();
+    }
+
+private:
+    struct Pending {
+        TileRequest request;
+        std::promise<TilePtr> promise;
+    };
+
+    static std::shared_future<TilePtr> ready(TilePtr tile) {
+        std::promise<TilePtr> promise;
+        promise.set_value(std::move(tile));
+        return promise.get_future().share();
+    }
+
+    void renderLoop() {
+        while (true) {
+            std::vector<Pending> batch;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return stopping || !queue.empty(); });
+                if (stopping) return;
+                size_t pixels = 0;
+                while (!queue.empty()) {
+                    const TileRequest& request = queue.front().request;
+                    size_t size = (size_t)request.width * request.height;
+                    if (!batch.empty() && pixels + size > batchPixels) break;
+                    pixels += size;
+                    batch.push_back(std::move(queue.front()));
+                    queue.pop_front();
+                }
+            }
+            renderBatch(batch);
+        }
+    }
+
+    void renderBatch(std::vector<Pending>& batch) {
+        struct Job {
+            CpuView view;
+            Colorizer colorize;
+            std::vector<float> mu;
+            std::vector<uint32_t> count;
+            std::shared_ptr<RenderedTile> tile;
+        };
+        std::vector<Job> jobs(batch.size());
+        std::vector<OrbitPtr> batchOrbits = resolveOrbits(batch);
+        std::vector<Tile> blocks;
+        for (size_t i = 0; i < batch.size(); i++) {
+            const TileRequest& request = batch[i].request;
+            ViewParams view = request.view();
+            Job& job = jobs[i];
+            job.view = cpuView(view, std::move(batchOrbits[i]));
+            job.colorize = {&palettes[view.palette], view.contrastEnhance, view.colorZoom};
+            job.mu.resize((size_t)request.width * request.height);
+            job.count.resize(job.mu.size());
+            job.tile = std::make_shared<RenderedTile>();
+            job.tile->width = request.width;
+            job.tile->height = request.height;
+            job.tile->rgb.resize(job.mu.size() * 3);
+
+            // Priority is the job's place in the batch, so the oldest request finishes first
+            for (int y = 0; y < request.height; y += blockSize) {
+                for (int x = 0; x < request.width; x += blockSize) {
+                    Tile block;
+                    block.x = x;
+                    block.y = y;
+                    block.width = std::min(blockSize, request.width - x);
+                    block.height = std::min(blockSize, request.height - y);
+                    block.priority = (int)i;
+                    block.cost = (double)block.width * block.height;
+                    blocks.push_back(block);
+                }
+            }
+        }
+
+        scheduler.run(blocks, [&jobs](const Tile& block, int) {
+            Job& job = jobs[block.priority];
+            const CpuView& view = job.view;
+            size_t first = (size_t)block.y * view.width + block.x;
+            iterateBlock(view, block.x, block.y, block.width, block.height, view.width, &job.mu[first],
+                         &job.count[first], nullptr);
+            for (int y = block.y; y < block.y + block.height; y++) {
+                size_t row = (size_t)y * view.width + block.x;
+                job.colorize(&job.mu[row], block.width, view.maxIterations, view.zoom, &job.tile->rgb[row * 3]);
+            }
+        });
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            batches++;
+            for (size_t i = 0; i < batch.size(); i++) {
+                const TileRequest& request = batch[i].request;
+                inFlight.erase(request);
+                rendered++;
+                size_t bytes = jobs[i].tile->bytes();
+                if (bytes > cacheLimit) continue;
+                cache.push_front({request, jobs[i].tile, bytes});
+                cacheIndex[request] = cache.begin();
+                cacheBytes += bytes;
+                evict();
+            }
+        }
+        for (size_t i = 0; i < batch.size(); i++) batch[i].promise.set_value(jobs[i].tile);
+    }
+
+    // The reference orbit of every perturbed request, null for the others.
+    // Orbits the cache doesn't have are computed in parallel, one for each
+    // group of requests that a single orbit covers.
+    std::vector<OrbitPtr> resolveOrbits(const std::vector<Pending>& batch) {
+        struct Missing {
+            double x, y;
+            int maxIterations;
+            OrbitPtr orbit;
+        };
+        std::vector<OrbitPtr> result(batch.size());
+        std::vector<Missing> missing;
+        std::vector<int> missingIndex(batch.size(), -1);
+        for (size_t i = 0; i < batch.size(); i++) {
+            const TileRequest& request = batch[i].request;
+            if (!request.view().perturbed()) continue;
+            // A zoom of 0 takes only an orbit iterated at exactly the anchor
+            double x = request.anchored ? request.anchorX : request.centerX;
+            double y = request.anchored ? request.anchorY : request.centerY;
+            double zoom = request.anchored ? 0.0 : request.zoom;
+            result[i] = orbits.find(x, y, zoom, request.maxIterations);
+            if (result[i]) continue;
+            auto covering = std::find_if(missing.begin(), missing.end(), [&](const Missing& other) {
+                return other.maxIterations >= request.maxIterations
+                    && std::hypot(other.x - x, other.y - y) <= orbitValidExtent * zoom;
+            });
+            missingIndex[i] = (int)(covering - missing.begin());
+            if (covering == missing.end()) missing.push_back({x, y, request.maxIterations, nullptr});
+        }
+        if (missing.empty()) return result;
+
+        std::vector<Tile> tasks(missing.size());
+        for (size_t k = 0; k < missing.size(); k++) {
+            tasks[k].x = (int)k;
+            tasks[k].cost = missing[k].maxIterations;
+        }
+        scheduler.run(tasks, [&missing](const Tile& task, int) {
+            Missing& orbit = missing[task.x];
+            orbit.orbit = std::make_shared<const ReferenceOrbit>(
+                computeReferenceOrbit(orbit.x, orbit.y, orbit.maxIterations));
+        });
+        for (Missing& orbit : missing) orbits.add(orbit.orbit);
+        for (size_t i = 0; i < batch.size(); i++) {
+            if (missingIndex[i] >= 0) result[i] = missing[missingIndex[i]].orbit;
+        }
+        return result;
+    }
+
+    struct CacheEntry {
+        TileRequest request;
+        TilePtr tile;
+        size_t bytes;  // tile->bytes() when last counted
+    };
+
+    // Drops least recently used tiles until the cache fits; mutex held
+    void evict() {
+        while (cacheBytes > cacheLimit && !cache.empty()) {
+            cacheBytes -= cache.back().bytes;
+            cacheIndex.erase(cache.back().request);
+            cache.pop_back();
+        }
+    }
+
+    const std::vector<Palette> palettes;
+    TileScheduler scheduler;
+    OrbitCache orbits;  // render thread only
+    const size_t cacheLimit;  // bytes
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::deque<Pending> queue;
+    std::unordered_map<TileRequest, std::shared_future<TilePtr>, TileRequestHash> inFlight;
+    // Most recently used first
+    std::list<CacheEntry> cache;
+    std::unordered_map<TileRequest, std::list<CacheEntry>::iterator, TileRequestHash> cacheIndex;
+    size_t cacheBytes = 0;
+    uint64_t requests = 0, cacheHits = 0, deduplicated = 0, rendered = 0, batches = 0;
+
+    std::thread renderThread;  // last, so it starts once everything above exists
+};
+
+// Answers one request line; false once the connection is no longer usable
+bool handleRequest(int fd, const std::string& line, TileServer& server) {
+    size_t space = line.find(' ');
+    std::string command = line.substr(0, space);
+    if (command == "stats") return sendLine(fd, "ok stats " + server.stats());
+    if (command != "tile") return sendLine(fd, "error unknown command " + command);
+
+    TileRequest request;
+    bool png;
+    std::string error;
+    auto paletteIndex = [&palettes = server.paletteList()](const std::string& palette) {
+        char* end;
+        long number = std::strtol(palette.c_str(), &end, 10);
+        if (!palette.empty() && *end == '\0') return number >= 1 && number <= (long)palettes.size() ? (int)number - 1 : -1;
+        for (size_t i = 0; i < palettes.size(); i++) {
+            if (palettes[i].name == palette) return (int)i;
+        }
+        return -1;
+    };
+    std::string arguments = space == std::string::npos ? "" : line.substr(space + 1);
+    if (!parseTileRequest(arguments, paletteIndex, request, png, error)) return sendLine(fd, "error " + error);
+
+    std::shared_future<TilePtr> rendering = server.get(request);
+    while (rendering.wait_for(keepaliveInterval) != std::future_status::ready) {
+        if (!sendLine(fd, "busy")) return false;
+    }
+    TilePtr tile = rendering.get();
+    if (!tile) return sendLine(fd, "error server shutting down");
+    std::string header = std::string("ok ") + (png ? "png " : "raw ") + std::to_string(tile->width) + " "
+                       + std::to_string(tile->height) + " ";
+    if (png) {
+        const std::vector<uint8_t>& encoded = tile->encodedPng();
+        server.recharge(request);
+        if (encoded.empty()) return sendLine(fd, "error PNG encoding failed");
+        return sendLine(fd, header + std::to_string(encoded.size())) && sendAll(fd, encoded.data(), encoded.size());
+    }
+    // Rows go out top-down, like the PNG's
+    size_t stride = (size_t)tile->width * 3;
+    std::vector<uint8_t> raw(tile->rgb.size());
+    for (int y = 0; y < tile->height; y++)
+        std::copy_n(&tile->rgb[(size_t)(tile->height - 1 - y) * stride], stride, &raw[(size_t)y * stride]);
+    return sendLine(fd, header + std::to_string(raw.size())) && sendAll(fd, raw.data(), raw.size());
+}
+
+void serveConnection(int fd, TileServer& server) {
+    LineReader reader(fd);
+    std::string line;
+    while (reader.readLine(line)) {
+        if (line.empty()) continue;
+        if (!handleRequest(fd, line, server)) return;
+    }
+}
+
+// Connection threads, reaped as they finish and joined on shutdown
+class Connections {
+public:
+    explicit Connections(size_t limit) : limit(limit) {}
+
+    // Serves fd on a thread of its own, or turns it away once limit
+    // connections are open
+    void start(int fd, TileServer& server) {
+        std::lock_guard<std::mutex> lock(mutex);
+        reap();
+        if (connections.size() >= limit) {
+            sendLine(fd, "error too many connections");
+            close(fd);
+            return;
+        }
+        auto connection = std::make_shared<Connection>();
+        connection->fd = fd;
+        connection->thread = std::thread([connection, &server] {
+            serveConnection(connection->fd, server);
+            connection->done = true;
+        });
+        connections.push_back(connection);
+    }
+
+    // Unblocks every connection waiting on its client and joins them all
+    void closeAll() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& connection : connections) shutdown(connection->fd, SHUT_RDWR);
+        for (auto& connection : connections) {
+            connection->thread.join();
+            close(connection->fd);
+        }
+        connections.clear();
+    }
+
+private:
+    struct Connection {
+        int fd = -1;
+        std::thread thread;
+        std::atomic<bool> done{false};
+    };
+
+    void reap() {
+        for (auto it = connections.begin(); it != connections.end();) {
+            if ((*it)->done) {
+                (*it)->thread.join();
+                close((*it)->fd);
+                it = connections.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    const size_t limit;
+    std::mutex mutex;
+    std::list<std::shared_ptr<Connection>> connections;
+};
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::string address = "mandel.sock";
+    std::string paletteDir = MANDEL_PALETTE_DIR;
+    int threads = 0;
+    size_t cacheMb = 256;
+    std::string orbitDir = "orbit_cache";
+    size_t orbitMb = 256;
+    int maxConnections = 64;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--socket" && i + 1 < argc) {
+            address = argv[++i];
+        } else if (arg == "--threads" && i + 1 < argc) {
+            threads = std::atoi(argv[++i]);
+        } else if (arg == "--cache" && i + 1 < argc) {
+            cacheMb = (size_t)std::max(0, std::atoi(argv[++i]));
+        } else if (arg == "--orbit-cache" && i + 1 < argc) {
+            orbitDir = argv[++i];
+        } else if (arg == "--orbit-cache-mb" && i + 1 < argc) {
+            orbitMb = (size_t)std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--palettes" && i + 1 < argc) {
+            paletteDir = argv[++i];
+        } else if (arg == "--max-connections" && i + 1 < argc) {
+            maxConnections = std::max(1, std::atoi(argv[++i]));
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--socket path|host:port] [--threads N] [--cache MB] [--palettes dir]"
+                      << " [--orbit-cache dir] [--orbit-cache-mb MB] [--max-connections N]" << std::endl;
+            return -1;
+        }
+    }
+    std::vector<Palette> palettes = loadPalettes(paletteDir);
+    if (palettes.empty()) {
+        std::cerr << "No palettes in " << paletteDir << ", using the built-in ones" << std::endl;
+        palettes = builtinPalettes();
+    }
+
+    int listener = listenOn(address);
+    if (listener < 0) return 1;
+
+    // Every thread inherits the blocked signals; one thread waits for them and
+    // shuts the listener down, which makes the blocked accept() return
+    sigset_t stopSignals;
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGINT);
+    sigaddset(&stopSignals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stopSignals, nullptr);
+    std::atomic<bool> stopRequested{false};
+    std::thread signalThread([&] {
+        int signal;
+        sigwait(&stopSignals, &signal);
+        stopRequested = true;
+        shutdown(listener, SHUT_RDWR);
+    });
+
+    TileServer server(palettes, threads, cacheMb << 20, OrbitCache(orbitDir, 4, (uintmax_t)orbitMb << 20));
+    Connections connections((size_t)maxConnections);
+    std::cout << "Listening on " << address << " with " << server.threadCount() << " threads, "
+              << palettes.size() << " palettes" << std::endl;
+    while (!stopRequested) {
+        int fd = acceptConnection(listener);
+        if (fd < 0) {
+            if (stopRequested) break;
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            std::cerr << "accept failed: " << std::strerror(errno) << std::endl;
+            break;
+        }
+        connections.start(fd, server);
+    }
+
+    if (!stopRequested) pthread_kill(signalThread.native_handle(), SIGTERM);
+    signalThread.join();
+    close(listener);
+    if (!isTcpAddress(address) && address[0] != '@') unlink(address.c_str());
+    // Connections blocked on a render are released by stop()
+    server.stop();
+    connections.closeAll();
+    std::cout << server.stats() << std::endl;
+    return 0;
+}
@@ -0,0 +1,264 @@
+#include "orbit.h"
+
+#include <unistd.h>
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <thread>
+
+namespace {
+
+const char orbitMagic[8] = {'M', 'Z', 'O', 'R', 'B', 'I', 'T', '1'};
+
+struct OrbitFileHeader {
+    char magic[8];
+    double centerX, centerY;
+    int32_t precision;
+    int32_t maxIterations;
+    int32_t escaped;
+    int32_t length;
+};
+
+uint64_t bitsOf(double v) {
+    uint64_t bits;
+    std::memcpy(&bits, &v, sizeof(bits));
+    return bits;
+}
+
+double fromBits(uint64_t bits) {
+    double v;
+    std::memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+// The reference point a cache file name encodes; false for other files
+bool parseOrbitFileName(const std::string& name, double& centerX, double& centerY) {
+    unsigned long long x, y;
+    int precision, length = 0;
+    if (std::sscanf(name.c_str(), "orbit_%16llx_%16llx_p%d.bin%n", &x, &y, &precision, &length) != 3
+        || length != (int)name.size() || precision != orbitPrecision())
+        return false;
+    centerX = fromBits(x);
+    centerY = fromBits(y);
+    return true;
+}
+
+} // namespace
+
+int orbitPrecision() {
+    return std::numeric_limits<long double>::digits;
+}
+
+ReferenceOrbit computeReferenceOrbit(double centerX, double centerY, int maxIterations) {
+    ReferenceOrbit orbit;
+    orbit.centerX = centerX;
+    orbit.centerY = centerY;
+    orbit.precision = orbitPrecision();
+    orbit.maxIterations = maxIterations;
+    orbit.z.reserve(2 * (size_t)(maxIterations + 1));
+
+    long double c_re = centerX, c_im = centerY;
+    long double z_re = 0, z_im = 0;
+    orbit.z.push_back(0.0);
+    orbit.z.push_back(0.0);
+    for (int i = 0; i < maxIterations; i++) {
+        long double next_re = z_re * z_re - z_im * z_im + c_re;
+        z_im = 2 * z_re * z_im + c_im;
+        z_re = next_re;
+        orbit.z.push_back((double)z_re);
+        orbit.z.push_back((double)z_im);
+        if (z_re * z_re + z_im * z_im >= 16) {
+            orbit.escaped = true;
+            break;
+        }
+    }
+    return orbit;
+}
+
+bool orbitCoversView(const ReferenceOrbit& orbit, double centerX, double centerY, double zoom, int maxIterations) {
+    if (orbit.precision != orbitPrecision()) return false;
+    if (!orbit.escaped && orbit.maxIterations < maxIterations) return false;
+    double dx = centerX - orbit.centerX;
+    double dy = centerY - orbit.centerY;
+    return std::sqrt(dx * dx + dy * dy) <= orbitValidExtent * zoom;
+}
+
+OrbitCache::OrbitCache(std::string directory, size_t capacity, uintmax_t diskLimit)
+    : directory(std::move(directory)), capacity(capacity), diskLimit(diskLimit) {}
+
+std::shared_ptr<const ReferenceOrbit> OrbitCache::get(double centerX, double centerY, double zoom, int maxIterations) {
+    auto orbit = find(centerX, centerY, zoom, maxIterations);
+    if (!orbit) {
+        // Re-anchor on the view's center
+        orbit = std::make_shared<const ReferenceOrbit>(computeReferenceOrbit(centerX, centerY, maxIterations));
+        add(orbit);
+    }
+    return orbit;
+}
+
+std::shared_ptr<const ReferenceOrbit> OrbitCache::find(double centerX, double centerY, double zoom, int maxIterations) {
+    for (auto it = entries.begin(); it != entries.end(); ++it) {
+        if (orbitCoversView(**it, centerX, centerY, zoom, maxIterations)) {
+            auto orbit = *it;
+            entries.erase(it);
+            entries.push_front(orbit);
+            hitCount++;
+            return orbit;
+        }
+    }
+
+    // The view left every cached orbit's validity region: reuse one from disk
+    // that covers it, which another process or an earlier run may have computed
+    missCount++;
+    auto orbit = load(centerX, centerY, zoom, maxIterations);
+    if (orbit) remember(orbit);
+    return orbit;
+}
+
+void OrbitCache::add(std::shared_ptr<const ReferenceOrbit> orbit) {
+    save(*orbit);
+    remember(std::move(orbit));
+}
+
+void OrbitCache::remember(std::shared_ptr<const ReferenceOrbit> orbit) {
+    entries.push_front(std::move(orbit));
+    if (entries.size() > capacity) entries.pop_back();
+}
+
+std::string OrbitCache::pathFor(double centerX, double centerY) const {
+    char name[80];
+    std::snprintf(name, sizeof(name), "orbit_%016llx_%016llx_p%d.bin",
+                  (unsigned long long)bitsOf(centerX), (unsigned long long)bitsOf(centerY), orbitPrecision());
+    return (std::filesystem::path(directory) / name).string();
+}
+
+std::shared_ptr<const ReferenceOrbit> OrbitCache::load(double centerX, double centerY, double zoom,
+                                                       int maxIterations) const {
+    if (directory.empty()) return nullptr;
+
+    // File names give every cached reference point, so only the files near
+    // enough to cover the view are opened, nearest first
+    struct Candidate {
+        double distance;
+        std::filesystem::path path;
+    };
+    std::vector<Candidate> candidates;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(directory, ec)) {
+        double x, y;
+        if (!parseOrbitFileName(entry.path().filename().string(), x, y)) continue;
+        double distance = std::hypot(centerX - x, centerY - y);
+        if (distance <= orbitValidExtent * zoom) candidates.push_back({distance, entry.path()});
+    }
+    std::sort(candidates.begin(), candidates.end(),
+              [](const Candidate& a, const Candidate& b) { return a.distance < b.distance; });
+    for (const Candidate& candidate : candidates) {
+        auto orbit = loadFile(candidate.path.string());
+        if (orbit && orbitCoversView(*orbit, centerX, centerY, zoom, maxIterations)) {
+            // Mark the file as recently used for trimDirectory()
+            std::filesystem::last_write_time(candidate.path, std::filesystem::file_time_type::clock::now(), ec);
+            return orbit;
+        }
+    }
+    return nullptr;
+}
+
+std::shared_ptr<const ReferenceOrbit> OrbitCache::loadFile(const std::string& path) const {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return nullptr;
+
+    OrbitFileHeader header;
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))) return nullptr;
+    if (std::memcmp(header.magic, orbitMagic, sizeof(orbitMagic)) != 0) return nullptr;
+    // Size the buffer only from a length that agrees with both the header and
+    // the file, so a corrupt or truncated file cannot ask for a huge allocation
+    std::error_code ec;
+    uintmax_t fileSize = std::filesystem::file_size(path, ec);
+    if (ec || header.maxIterations <= 0 || header.length <= 0 || header.length > header.maxIterations + 1
+        || fileSize != sizeof(header) + 2 * sizeof(double) * (uintmax_t)header.length) return nullptr;
+
+    auto orbit = std::make_shared<ReferenceOrbit>();
+    orbit->centerX = header.centerX;
+    orbit->centerY = header.centerY;
+    orbit->precision = header.precision;
+    orbit->maxIterations = header.maxIterations;
+    orbit->escaped = header.escaped != 0;
+    orbit->z.resize(2 * (size_t)header.length);
+    if (!in.read(reinterpret_cast<char*>(orbit->z.data()), orbit->z.size() * sizeof(double))) return nullptr;
+    return orbit;
+}
+
+void OrbitCache::save(const ReferenceOrbit& orbit) const {
+    if (directory.empty()) return;
+    std::error_code ec;
+    std::filesystem::create_directories(directory, ec);
+    if (ec) {
+        std::cerr << "Orbit cache: cannot create " << directory << ": " << ec.message() << std::endl;
+        return;
+    }
+
+    std::string path = pathFor(orbit.centerX, orbit.centerY);
+    // Renderers in other threads or processes may be saving the same orbit
+    std::string tmpPath = path + "." + std::to_string(getpid()) + "."
+                        + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+    {
+        std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+        OrbitFileHeader header = {};
+        std::memcpy(header.magic, orbitMagic, sizeof(orbitMagic));
+        header.centerX = orbit.centerX;
+        header.centerY = orbit.centerY;
+        header.precision = orbit.precision;
+        header.maxIterations = orbit.maxIterations;
+        header.escaped = orbit.escaped ? 1 : 0;
+        header.length = orbit.length();
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(orbit.z.data()), orbit.z.size() * sizeof(double));
+        if (!out) {
+            std::cerr << "Orbit cache: failed to write " << tmpPath << std::endl;
+            return;
+        }
+    }
+    std::filesystem::rename(tmpPath, path, ec);
+    if (ec) {
+        std::cerr << "Orbit cache: failed to write " << path << ": " << ec.message() << std::endl;
+        return;
+    }
+    trimDirectory();
+}
+
+void OrbitCache::trimDirectory() const {
+    if (diskLimit == 0) return;
+
+    struct CachedFile {
+        std::filesystem::path path;
+        std::filesystem::file_time_type lastUse;
+        uintmax_t size;
+    };
+    std::vector<CachedFile> files;
+    uintmax_t total = 0;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(directory, ec)) {
+        std::string name = entry.path().filename().string();
+        if (name.rfind("orbit_", 0) != 0 || entry.path().extension() != ".bin") continue;
+        std::error_code entryError;
+        CachedFile file = {entry.path(), entry.last_write_time(entryError), entry.file_size(entryError)};
+        if (entryError) continue;  // removed by another process meanwhile
+        total += file.size;
+        files.push_back(std::move(file));
+    }
+    if (total <= diskLimit) return;
+
+    std::sort(files.begin(), files.end(),
+              [](const CachedFile& a, const CachedFile& b) { return a.lastUse < b.lastUse; });
+    for (const CachedFile& file : files) {
+        if (total <= diskLimit) break;
+        if (std::filesystem::remove(file.path, ec)) total -= file.size;
+    }
+}
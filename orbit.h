@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Reference orbit Z_0..Z_n of a single point C, iterated in extended precision.
+// Pixels near C are then rendered by perturbation against this orbit.
+struct ReferenceOrbit {
+    double centerX = 0.0, centerY = 0.0;
+    int precision = 0;      // mantissa bits the orbit was iterated with
+    int maxIterations = 0;  // iteration budget the orbit was computed for
+    bool escaped = false;   // orbit left the bailout radius before maxIterations
+    std::vector<double> z;  // interleaved re, im
+
+    int length() const { return (int)(z.size() / 2); }
+};
+
+// A reference stays usable while the view center is within this many zoom
+// units of it; further out the deltas lose too many bits against pixel spacing.
+const double orbitValidExtent = 4.0;
+
+// Mantissa bits of the type used to iterate reference orbits.
+int orbitPrecision();
+
+ReferenceOrbit computeReferenceOrbit(double centerX, double centerY, int maxIterations);
+
+// True if the orbit can be used to render the view at (centerX, centerY, zoom).
+bool orbitCoversView(const ReferenceOrbit& orbit, double centerX, double centerY, double zoom, int maxIterations);
+
+// Keeps the most recently used reference orbits in memory and on disk so that
+// small zoom steps and repeated zoom paths reuse an existing orbit. A miss in
+// memory takes any orbit on disk that covers the view, so renders in other
+// processes and later runs share the orbits already computed. The
+// directory is kept under diskLimit bytes by dropping the least recently used
+// files; 0 disables the limit.
+class OrbitCache {
+public:
+    explicit OrbitCache(std::string directory = "orbit_cache", size_t capacity = 4,
+                        uintmax_t diskLimit = 256ull << 20);
+
+    // An orbit that covers the view; a zoom of 0 asks for the orbit of exactly
+    // (centerX, centerY)
+    std::shared_ptr<const ReferenceOrbit> get(double centerX, double centerY, double zoom, int maxIterations);
+
+    // get() split for callers that compute the missing orbits themselves:
+    // find() returns null where get() would compute, and add() keeps an orbit
+    // computed after a miss
+    std::shared_ptr<const ReferenceOrbit> find(double centerX, double centerY, double zoom, int maxIterations);
+    void add(std::shared_ptr<const ReferenceOrbit> orbit);
+
+    int hits() const { return hitCount; }
+    int misses() const { return missCount; }
+
+private:
+    void remember(std::shared_ptr<const ReferenceOrbit> orbit);
+    std::string pathFor(double centerX, double centerY) const;
+    // The nearest orbit on disk that covers the view, or null
+    std::shared_ptr<const ReferenceOrbit> load(double centerX, double centerY, double zoom, int maxIterations) const;
+    std::shared_ptr<const ReferenceOrbit> loadFile(const std::string& path) const;
+    void save(const ReferenceOrbit& orbit) const;
+    void trimDirectory() const;
+
+    std::string directory;
+    size_t capacity;
+    uintmax_t diskLimit;
+    std::list<std::shared_ptr<const ReferenceOrbit>> entries;  // most recent first
+    int hitCount = 0, missCount = 0;
+};
@@ -0,0 +1,49 @@
+#include "renderer.h"
+
+#include <iostream>
+
+#include "cpu_renderer.h"
+#include "orbit.h"
+
+namespace {
+
+class CpuBackend : public Renderer {
+public:
+    CpuBackend(std::vector<Palette> palettes, int threadCount)
+        : palettes(std::move(palettes)), engine(threadCount) {}
+
+    bool render(const ViewParams& view, RenderResult& result) override {
+        if (view.palette < 0 || view.palette >= (int)palettes.size()) {
+            std::cerr << "No palette " << view.palette + 1 << std::endl;
+            return false;
+        }
+        if (view.width <= 0 || view.height <= 0) {
+            std::cerr << "Invalid render size " << view.width << "x" << view.height << std::endl;
+            return false;
+        }
+        std::shared_ptr<const ReferenceOrbit> orbit;
+        if (view.perturbed()) orbit = orbits.get(view.centerX, view.centerY, view.zoom, view.maxIterations);
+        const Palette& palette = palettes[view.palette];
+        result.iterations = engine.render(cpuView(view, orbit), {&palette, view.contrastEnhance, view.colorZoom},
+                                          view.supersample);
+        if (view.histogram) engine.equalize(palette);
+        result.width = view.width;
+        result.height = view.height;
+        result.rgb = engine.pixels();
+        result.mu = engine.iterations();
+        return true;
+    }
+
+    std::string name() const override { return "cpu"; }
+
+private:
+    const std::vector<Palette> palettes;
+    CpuRenderer engine;
+    OrbitCache orbits;
+};
+
+} // namespace
+
+std::unique_ptr<Renderer> createCpuRenderer(std::vector<Palette> palettes, int threadCount) {
+    return std::make_unique<CpuBackend>(std::move(palettes), threadCount);
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "colorize.h"
+#include "view_params.h"
+
+// One rendered view
+struct RenderResult {
+    int width = 0, height = 0;
+    std::vector<uint8_t> rgb;  // RGB8, rows bottom-up
+    std::vector<float> mu;     // smooth escape counts, if the backend keeps them; empty otherwise
+    uint64_t iterations = 0;   // iterations of the base image, where the backend counts them
+};
+
+// Turns a ViewParams into an image. An instance owns everything it renders
+// with (threads, buffers, reference orbits, GL context) and renders one view
+// at a time; separate instances share nothing and render in parallel.
+class Renderer {
+public:
+    virtual ~Renderer() = default;
+
+    // Blocks until view is rendered into result. False, after printing why, if
+    // this backend cannot render the view.
+    virtual bool render(const ViewParams& view, RenderResult& result) = 0;
+    virtual std::string name() const = 0;
+};
+
+// The CPU engine (see cpu_renderer.h) on threadCount threads, 0 for one per
+// core. Renders every option of ViewParams.
+std::unique_ptr<Renderer> createCpuRenderer(std::vector<Palette> palettes, int threadCount = 0);
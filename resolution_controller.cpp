@@ -0,0 +1,53 @@
+#include "resolution_controller.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+const double smoothing = 0.3;   // weight of the newest sample
+const double maxSampleMs = 1000.0;  // longer frames are stalls (shader compiles), not render cost
+const double minScale = 0.125;
+const double scaleStep = 1.0 / 32.0;
+
+// Hysteresis: shrink once the ideal scale is 10% below the current one,
+// grow only once it is 20% above, so noise never flips the resolution back and forth
+const double shrinkThreshold = 0.9;
+const double growThreshold = 1.2;
+
+} // namespace
+
+ResolutionController::ResolutionController(double targetMs) : targetMs(targetMs) {}
+
+void ResolutionController::addSample(const FrameStats& stats) {
+    double pixels = (double)stats.renderWidth * stats.renderHeight;
+    double scaledMs = stats.stageMs[StageIterate] + stats.stageMs[StageSupersample] + stats.stageMs[StageColorize];
+    if (pixels <= 0.0 || scaledMs <= 0.0 || scaledMs > maxSampleMs) return;
+
+    double perPixel = scaledMs / pixels;
+    double fixed = stats.stageMs[StageBlit];
+    if (msPerPixel == 0.0) {
+        msPerPixel = perPixel;
+        fixedMs = fixed;
+    } else {
+        msPerPixel += smoothing * (perPixel - msPerPixel);
+        fixedMs += smoothing * (fixed - fixedMs);
+    }
+}
+
+double ResolutionController::scale(int windowWidth, int windowHeight, bool moving) {
+    if (!moving) return 1.0;
+    if (msPerPixel == 0.0) return movingScale;  // no measurements yet
+
+    double budget = std::max(targetMs - fixedMs, 0.1 * targetMs);
+    double pixels = (double)windowWidth * windowHeight;
+    double ideal = std::sqrt(budget / (msPerPixel * pixels));
+    ideal = std::min(std::max(ideal, minScale), 1.0);
+
+    bool shrink = ideal < movingScale * shrinkThreshold;
+    bool grow = ideal > movingScale * growThreshold || (ideal == 1.0 && movingScale < 1.0);
+    if (shrink || grow) {
+        movingScale = std::max(std::floor(ideal / scaleStep) * scaleStep, minScale);
+    }
+    return movingScale;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "frame_stats.h"
+
+// Picks the render scale while the view is moving so that a frame fits the
+// target budget. Cost is tracked per pixel from GPU timings, so the estimate
+// follows hardware speed, zoom depth and maxIterations without retuning.
+class ResolutionController {
+public:
+    explicit ResolutionController(double targetMs = 16.0);
+
+    // Feeds a finished frame's timings; frames arrive a few frames late
+    void addSample(const FrameStats& stats);
+
+    // Render scale (fraction of the window's width and height) for the next frame.
+    // Idle frames always render at full resolution.
+    double scale(int windowWidth, int windowHeight, bool moving);
+
+private:
+    double targetMs;
+    double msPerPixel = 0.0;  // smoothed cost of iterate + colorize
+    double fixedMs = 0.0;     // smoothed cost that does not scale with render size (blit)
+    double movingScale = 0.25;
+};
@@ -0,0 +1,620 @@
+#include "shaders.h"
+
+#include <iostream>
+
+const char* vertexShaderSource = R"(
+#version 410 core
+layout (location = 0) in vec2 aPos;
+void main() {
+    gl_Position = vec4(aPos, 0.0, 1.0);
+}
+)";
+
+// All per-frame view parameters, uploaded once per frame as a std140 uniform block
+const char* viewUniformsSource = R"(
+layout(std140) uniform ViewState {
+    dvec2 u_center;
+    dvec2 u_refOffset;
+    double u_zoom;
+    vec2 u_resolution;
+    int u_maxIterations;
+    int u_orbitLength;
+    vec2 u_jitter;  // sub-pixel offset of this frame's samples, for temporal accumulation
+};
+)";
+
+// Shared by the fragment and compute kernels. Built with PERTURB and DISTANCE defined to 0 or 1; with DISTANCE the
+// derivative dz/dc is iterated too, for distanceEstimate().
+const char* iterationSource = R"(
+struct IterState {
+    dvec2 z;
+    dvec2 dz;
+    dvec2 c;
+    int m;
+    int iter;
+#if DISTANCE
+    dvec2 dzdc;  // of the full z, so it carries through perturbation and rebasing
+#endif
+};
+
+#if PERTURB
+uniform usamplerBuffer u_orbit;
+
+dvec2 orbitAt(int n) {
+    uvec4 t = texelFetch(u_orbit, n);
+    return dvec2(packDouble2x32(t.xy), packDouble2x32(t.zw));
+}
+#endif
+
+IterState startIteration(vec2 uv) {
+    IterState s;
+    s.z = dvec2(0.0);
+    s.dz = dvec2(0.0);
+    s.m = 0;
+    s.iter = 0;
+#if DISTANCE
+    s.dzdc = dvec2(0.0);
+#endif
+#if PERTURB
+    // For perturbation c holds the offset from the reference point instead
+    s.c = u_refOffset + dvec2(uv) * u_zoom;
+#else
+    s.c = u_center + dvec2(uv) * u_zoom;
+#endif
+    return s;
+}
+
+// Runs the point until it escapes or hits u_maxIterations
+void iterate(inout IterState s) {
+#if PERTURB
+    // Past double precision we iterate the offset dz from a reference orbit Z: z = Z + dz
+    while (dot(s.z, s.z) < 16.0 && s.iter < u_maxIterations) {
+#if DISTANCE
+        s.dzdc = 2.0 * dvec2(s.z.x * s.dzdc.x - s.z.y * s.dzdc.y, s.z.x * s.dzdc.y + s.z.y * s.dzdc.x) + dvec2(1.0, 0.0);
+#endif
+        dvec2 Z = orbitAt(s.m);
+        dvec2 dz = s.dz;
+        s.dz = dvec2(2.0 * (Z.x * dz.x - Z.y * dz.y) + dz.x * dz.x - dz.y * dz.y,
+                     2.0 * (Z.x * dz.y + Z.y * dz.x + dz.x * dz.y)) + s.c;
+        s.m++;
+        s.z = orbitAt(s.m) + s.dz;
+        s.iter++;
+        // Rebase onto the start of the orbit once it stops being a good approximation
+        if (dot(s.z, s.z) < dot(s.dz, s.dz) || s.m == u_orbitLength - 1) {
+            s.dz = s.z;
+            s.m = 0;
+        }
+    }
+#else
+    dvec2 c = s.c;
+    while (dot(s.z, s.z) < 16.0 && s.iter < u_maxIterations) {
+#if DISTANCE
+        s.dzdc = 2.0 * dvec2(s.z.x * s.dzdc.x - s.z.y * s.dzdc.y, s.z.x * s.dzdc.y + s.z.y * s.dzdc.x) + dvec2(1.0, 0.0);
+#endif
+        s.z = dvec2(s.z.x * s.z.x - s.z.y * s.z.y + c.x, 2.0 * s.z.x * s.z.y + c.y);
+        s.iter++;
+    }
+#endif
+}
+
+// Continuous escape count, or u_maxIterations for points that never escaped
+float smoothIterations(IterState s) {
+    if (s.iter >= u_maxIterations) return float(u_maxIterations);
+    return float(s.iter) - log2(log2(length(vec2(s.z))));
+}
+
+#if DISTANCE
+// Exterior distance estimate |z| ln|z| / 2|dz/dc| in pixels, 0 for points that
+// never escaped. Only the logarithm is single precision; |dz/dc| easily
+// outgrows a float.
+float distanceEstimate(IterState s) {
+    if (s.iter >= u_maxIterations) return 0.0;
+    float radius = length(vec2(s.z));
+    double estimate = double(0.5 * radius * log(radius)) / length(s.dzdc);
+    return float(estimate * double(min(u_resolution.x, u_resolution.y)) / u_zoom);
+}
+#endif
+)";
+
+// Histogram bin of an escaped pixel; twin of histogramBin() in colorize.h
+const char* histogramBinSource = R"(
+int histogramBin(float mu) {
+    return min(int(max(mu, 0.0) / float(u_maxIterations) * float(HISTOGRAM_BINS)), HISTOGRAM_BINS - 1);
+}
+)";
+
+// Built with CONTRAST_ENHANCE (0 or 1) and PALETTE_PERIOD defined. The palette
+// is a lookup table in a 1D texture on paletteTextureUnit, so switching
+// palettes needs no new variant. With HISTOGRAM 1 the palette is indexed by the CDF of the escape counts
+// instead, which needs the compute path's storage buffers.
+const char* coloringSource = R"(
+uniform sampler1D u_palette;
+
+#if HISTOGRAM
+layout(std430, binding = 3) readonly buffer Cdf {
+    float cdf[];
+};
+#endif
+
+vec4 colorFor(float mu) {
+    if (mu >= float(u_maxIterations)) {
+        return vec4(0.0, 0.0, 0.0, 1.0);
+    }
+#if HISTOGRAM
+    // Share of escaped pixels with a lower count, interpolated within the bin
+    float x = clamp(mu / float(u_maxIterations), 0.0, 1.0) * float(HISTOGRAM_BINS);
+    int bin = histogramBin(mu);
+    float below = bin > 0 ? cdf[bin - 1] : 0.0;
+    float t = mix(below, cdf[bin], x - float(bin)) * HISTOGRAM_RANGE;
+#else
+    // Smooth iteration count
+    float smooth_iter = mu + 4.0;
+
+    // Increase color frequency as we zoom in to maintain contrast/detail
+    float color_freq = 0.1;
+#if CONTRAST_ENHANCE
+    float zoom_log = max(0.0, float(-log(float(u_zoom)) / log(10.0)));
+    color_freq += zoom_log * 0.05;
+#endif
+
+    float t = smooth_iter * color_freq;
+#endif
+
+    // One texture fetch: the palette LUT repeats every PALETTE_PERIOD of phase
+    vec3 color = texture(u_palette, t / PALETTE_PERIOD).rgb;
+    return vec4(color, 1.0);
+}
+
+#if DISTANCE
+// Twin of distanceShade() in colorize.h
+float distanceShade(float distance) {
+    return smoothstep(0.0, 1.0, distance / DISTANCE_SHADE_WIDTH);
+}
+#endif
+)";
+
+const char* fragmentShaderSource = R"(
+out vec4 FragColor;
+
+void main() {
+    vec2 uv = (gl_FragCoord.xy + u_jitter - 0.5 * u_resolution.xy) / min(u_resolution.y, u_resolution.x);
+
+    // We use double precision for the Mandelbrot calculation to allow deeper zooming
+    IterState s = startIteration(uv);
+    iterate(s);
+#ifdef OUTPUT_ITERATIONS
+    // Raw smooth count into a float target, for comparing against the other engines
+    FragColor = vec4(smoothIterations(s), 0.0, 0.0, 1.0);
+#else
+    vec4 color = colorFor(smoothIterations(s));
+#if DISTANCE
+    color.rgb *= distanceShade(distanceEstimate(s));
+#endif
+    FragColor = color;
+#endif
+}
+)";
+
+#ifdef MANDEL_HAVE_COMPUTE
+// Persistent workgroups over 8x8 tiles: a group takes the next tile from an
+// atomic queue, renders it, and takes another, up to u_tilesPerGroup, so the
+// groups that draw cheap tiles go on to more of the frame instead of retiring.
+// The bound is for Mesa's llvmpipe, which ends an outermost loop after a fixed
+// budget that counts every inner iteration of every tile the group takes; the
+// host keeps the group's tiles within it there (see ComputePasses::iterate()).
+// Enough groups are dispatched that the queue always runs dry first.
+const char* computeShaderSource = R"(
+layout(local_size_x = 8, local_size_y = 8) in;
+
+uniform uint u_tilesPerGroup;
+
+layout(std430, binding = 0) writeonly buffer Iterations {
+    float iterations[];
+};
+layout(std430, binding = 1) buffer FrameCounters {
+    uint iterationsLow;
+    uint iterationsHigh;
+    uint nextTile;
+};
+#if DISTANCE
+layout(std430, binding = 7) writeonly buffer Distances {
+    float distances[];
+};
+#endif
+
+shared uint tileIndex;
+shared uint tileIterations;
+
+void main() {
+    ivec2 size = ivec2(u_resolution);
+    float minRes = float(min(size.x, size.y));
+    int tilesX = (size.x + 7) / 8;
+    uint tileCount = uint(tilesX * ((size.y + 7) / 8));
+
+    for (uint taken = 0u; taken < u_tilesPerGroup; taken++) {
+        if (gl_LocalInvocationIndex == 0u) {
+            tileIndex = atomicAdd(nextTile, 1u);
+            tileIterations = 0u;
+        }
+        barrier();
+        uint tile = tileIndex;
+        if (tile >= tileCount) break;
+
+        ivec2 pixel = ivec2(int(tile) % tilesX, int(tile) / tilesX) * 8 + ivec2(gl_LocalInvocationID.xy);
+        if (all(lessThan(pixel, size))) {
+            vec2 uv = (vec2(pixel) + 0.5 + u_jitter - 0.5 * u_resolution) / minRes;
+            IterState s = startIteration(uv);
+            iterate(s);
+            iterations[pixel.y * size.x + pixel.x] = smoothIterations(s);
+#if DISTANCE
+            distances[pixel.y * size.x + pixel.x] = distanceEstimate(s);
+#endif
+            atomicAdd(tileIterations, uint(s.iter));
+        }
+
+        // 64-bit frame total for the stats overlay, carried by hand. The
+        // barrier also keeps lane 0 from taking the next tile early.
+        barrier();
+        if (gl_LocalInvocationIndex == 0u) {
+            uint before = atomicAdd(iterationsLow, tileIterations);
+            if (before + tileIterations < before) atomicAdd(iterationsHigh, 1u);
+        }
+    }
+}
+)";
+
+
+// First pass of histogram coloring. Each group bins a strided share of the
+// iteration buffer with shared-memory atomics and adds its nonzero bins to the
+// global histogram, so global atomics scale with bins rather than pixels.
+const char* histogramShaderSource = R"(
+layout(local_size_x = 256) in;
+
+layout(std430, binding = 0) readonly buffer Iterations {
+    float iterations[];
+};
+layout(std430, binding = 2) buffer Histogram {
+    uint bins[];
+};
+
+shared uint groupBins[HISTOGRAM_BINS];
+
+void main() {
+    for (uint i = gl_LocalInvocationIndex; i < uint(HISTOGRAM_BINS); i += 256u) groupBins[i] = 0u;
+    barrier();
+
+    uint count = uint(u_resolution.x) * uint(u_resolution.y);
+    uint stride = gl_NumWorkGroups.x * 256u;
+    for (uint p = gl_GlobalInvocationID.x; p < count; p += stride) {
+        float mu = iterations[p];
+        if (mu < float(u_maxIterations)) atomicAdd(groupBins[histogramBin(mu)], 1u);
+    }
+    barrier();
+
+    for (uint i = gl_LocalInvocationIndex; i < uint(HISTOGRAM_BINS); i += 256u) {
+        if (groupBins[i] != 0u) atomicAdd(bins[i], groupBins[i]);
+    }
+}
+)";
+
+// Second pass: one group turns the histogram into the normalized CDF. Each
+// lane sums a run of bins, a Hillis-Steele scan in shared memory gives the
+// total before each run, and the lanes write their runs out. The bins are
+// cleared on the way for the next frame.
+const char* scanShaderSource = R"(
+#define SCAN_LANES 1024
+#define BINS_PER_LANE (HISTOGRAM_BINS / SCAN_LANES)
+layout(local_size_x = SCAN_LANES) in;
+
+layout(std430, binding = 2) buffer Histogram {
+    uint bins[];
+};
+layout(std430, binding = 3) writeonly buffer Cdf {
+    float cdf[];
+};
+
+shared uint laneTotals[SCAN_LANES];
+
+void main() {
+    uint lane = gl_LocalInvocationIndex;
+    uint first = lane * uint(BINS_PER_LANE);
+    uint run[BINS_PER_LANE];
+    uint sum = 0u;
+    for (int i = 0; i < BINS_PER_LANE; i++) {
+        sum += bins[first + uint(i)];
+        run[i] = sum;
+        bins[first + uint(i)] = 0u;
+    }
+    laneTotals[lane] = sum;
+    barrier();
+
+    for (uint offset = 1u; offset < uint(SCAN_LANES); offset <<= 1) {
+        uint add = lane >= offset ? laneTotals[lane - offset] : 0u;
+        barrier();
+        laneTotals[lane] += add;
+        barrier();
+    }
+
+    uint before = lane > 0u ? laneTotals[lane - 1u] : 0u;
+    uint total = laneTotals[SCAN_LANES - 1];
+    float scale = total > 0u ? 1.0 / float(total) : 0.0;
+    for (int i = 0; i < BINS_PER_LANE; i++) cdf[first + uint(i)] = float(before + run[i]) * scale;
+}
+)";
+
+// Adaptive supersampling; twin of supersample.h. The flag pass appends the
+// edge pixels to a list and gives each a slot in the subsample buffer, or -1,
+// while counting the groups of the refine pass into its indirect dispatch.
+const char* supersampleSource = R"(
+#define REFINE_GROUP_SIZE 64
+
+layout(std430, binding = 4) buffer RefineList {
+    uint groupsX, groupsY, groupsZ;  // indirect dispatch of the refine pass
+    uint refineCount;                // may pass the list's capacity; the rest stay unrefined
+    uint refinePixels[];
+};
+
+vec2 subsampleOffset(ivec2 pixel, int k) {
+    uint h = uint(pixel.x) * 0x8da6b343u ^ uint(pixel.y) * 0xd8163841u ^ uint(k) * 0xcb1ab31fu;
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    h *= 0x846ca68bu;
+    h ^= h >> 16;
+    return (vec2(float(k & 1), float(k >> 1)) + vec2(float(h & 0xffffu), float(h >> 16)) * (1.0 / 65536.0)) * 0.5;
+}
+)";
+
+const char* refineFlagShaderSource = R"(
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(std430, binding = 0) readonly buffer Iterations {
+    float iterations[];
+};
+layout(std430, binding = 5) writeonly buffer RefineSlots {
+    int refineSlot[];
+};
+#if DISTANCE
+layout(std430, binding = 7) readonly buffer Distances {
+    float distances[];
+};
+#endif
+
+bool needsSupersampling(ivec2 pixel, ivec2 size) {
+    const ivec2 neighbors[4] = ivec2[4](ivec2(-1, 0), ivec2(1, 0), ivec2(0, -1), ivec2(0, 1));
+#if DISTANCE
+    if (distances[pixel.y * size.x + pixel.x] > SUPERSAMPLE_DISTANCE) return false;
+#endif
+    float center = iterations[pixel.y * size.x + pixel.x];
+    for (int i = 0; i < 4; i++) {
+        ivec2 n = pixel + neighbors[i];
+        if (any(lessThan(n, ivec2(0))) || any(greaterThanEqual(n, size))) continue;
+        if (abs(iterations[n.y * size.x + n.x] - center) > SUPERSAMPLE_THRESHOLD) return true;
+    }
+    return false;
+}
+
+void main() {
+    ivec2 size = ivec2(u_resolution);
+    ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+    if (any(greaterThanEqual(pixel, size))) return;
+
+    int index = pixel.y * size.x + pixel.x;
+    int slot = -1;
+    if (needsSupersampling(pixel, size)) {
+        uint claimed = atomicAdd(refineCount, 1u);
+        if (claimed < uint(refinePixels.length())) {
+            slot = int(claimed);
+            refinePixels[claimed] = uint(index);
+            // Slots are handed out in order, so this counts ceil(slots / pixels per group)
+            if (claimed % uint(REFINE_GROUP_SIZE / SUPERSAMPLE_COUNT) == 0u) atomicAdd(groupsX, 1u);
+        }
+    }
+    refineSlot[index] = slot;
+}
+)";
+
+// One invocation per subsample, so the lanes of a group stay busy even though
+// the edge pixels are scattered over the frame
+const char* refineShaderSource = R"(
+layout(local_size_x = REFINE_GROUP_SIZE) in;
+
+layout(std430, binding = 6) writeonly buffer Subsamples {
+    float subsampleMu[];
+};
+
+void main() {
+    uint slot = gl_GlobalInvocationID.x / uint(SUPERSAMPLE_COUNT);
+    int k = int(gl_GlobalInvocationID.x % uint(SUPERSAMPLE_COUNT));
+    if (slot >= min(refineCount, uint(refinePixels.length()))) return;
+
+    int width = int(u_resolution.x);
+    int index = int(refinePixels[slot]);
+    ivec2 pixel = ivec2(index % width, index / width);
+    float minRes = min(u_resolution.x, u_resolution.y);
+    vec2 uv = (vec2(pixel) + subsampleOffset(pixel, k) + u_jitter - 0.5 * u_resolution) / minRes;
+    IterState s = startIteration(uv);
+    iterate(s);
+    subsampleMu[slot * uint(SUPERSAMPLE_COUNT) + uint(k)] = smoothIterations(s);
+}
+)";
+
+#endif
+
+// Colors the iteration buffer written by the compute kernel. With SUPERSAMPLE 1
+// the pixels the refine pass gave a slot get the average of all their samples;
+// with DISTANCE 1 the result is shaded by the kernel's distance estimates.
+const char* colorizeShaderSource = R"(
+layout(std430, binding = 0) readonly buffer Iterations {
+    float iterations[];
+};
+#if SUPERSAMPLE
+layout(std430, binding = 5) readonly buffer RefineSlots {
+    int refineSlot[];
+};
+layout(std430, binding = 6) readonly buffer Subsamples {
+    float subsampleMu[];
+};
+#endif
+#if DISTANCE
+layout(std430, binding = 7) readonly buffer Distances {
+    float distances[];
+};
+#endif
+out vec4 FragColor;
+
+void main() {
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    int index = pixel.y * int(u_resolution.x) + pixel.x;
+    vec4 color = colorFor(iterations[index]);
+#if SUPERSAMPLE
+    int slot = refineSlot[index];
+    if (slot >= 0) {
+        for (int k = 0; k < SUPERSAMPLE_COUNT; k++) color += colorFor(subsampleMu[slot * SUPERSAMPLE_COUNT + k]);
+        color /= float(SUPERSAMPLE_COUNT + 1);
+    }
+#endif
+#if DISTANCE
+    color.rgb *= distanceShade(distances[index]);
+#endif
+    FragColor = color;
+}
+)";
+
+// Adds the frame in fboTexture to the running average; the weight of the new
+// frame is set with glBlendColor
+const char* accumulateShaderSource = R"(
+#version 410 core
+uniform sampler2D u_frame;
+out vec4 FragColor;
+
+void main() {
+    FragColor = vec4(texelFetch(u_frame, ivec2(gl_FragCoord.xy), 0).rgb, 1.0);
+}
+)";
+
+GLuint compileShader(GLenum type, std::initializer_list<const char*> sources) {
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, (GLsizei)sources.size(), sources.begin(), NULL);
+    glCompileShader(shader);
+    
+    int success;
+    char infoLog[512];
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (!success) {
+        glGetShaderInfoLog(shader, 512, NULL, infoLog);
+        std::cerr << "Shader Compilation Error: " << infoLog << std::endl;
+    }
+    return shader;
+}
+
+GLuint linkProgram(std::initializer_list<GLuint> shaders) {
+    GLuint program = glCreateProgram();
+    for (GLuint shader : shaders) glAttachShader(program, shader);
+    glLinkProgram(program);
+    for (GLuint shader : shaders) glDeleteShader(shader);
+
+    int success;
+    char infoLog[512];
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        glGetProgramInfoLog(program, 512, NULL, infoLog);
+        std::cerr << "Program Link Error: " << infoLog << std::endl;
+    }
+    return program;
+}
+
+void bindViewState(GLuint program) {
+    GLuint block = glGetUniformBlockIndex(program, "ViewState");
+    if (block != GL_INVALID_INDEX) glUniformBlockBinding(program, block, viewStateBinding);
+    GLint orbitLocation = glGetUniformLocation(program, "u_orbit");
+    if (orbitLocation >= 0) {
+        glUseProgram(program);
+        glUniform1i(orbitLocation, orbitTextureUnit);
+    }
+    GLint paletteLocation = glGetUniformLocation(program, "u_palette");
+    if (paletteLocation >= 0) {
+        glUseProgram(program);
+        glUniform1i(paletteLocation, paletteTextureUnit);
+    }
+}
+
+GLuint createPaletteTexture(const Palette& palette) {
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_1D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage1D(GL_TEXTURE_1D, 0, GL_RGB8, palette.size(), 0, GL_RGB, GL_UNSIGNED_BYTE, palette.rgb.data());
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    return texture;
+}
+
+namespace {
+const char* glsl410 = "#version 410 core\n";
+const char* glsl430 = "#version 430 core\n";
+} // namespace
+
+GLuint buildFragmentProgram(const std::string& defines) {
+    GLuint program = linkProgram({
+        compileShader(GL_VERTEX_SHADER, {vertexShaderSource}),
+        compileShader(GL_FRAGMENT_SHADER, {glsl410, defines.c_str(), viewUniformsSource, iterationSource, histogramBinSource, coloringSource, fragmentShaderSource})
+    });
+    bindViewState(program);
+    return program;
+}
+
+GLuint buildAccumulateProgram() {
+    return linkProgram({
+        compileShader(GL_VERTEX_SHADER, {vertexShaderSource}),
+        compileShader(GL_FRAGMENT_SHADER, {accumulateShaderSource})
+    });
+}
+
+GLuint buildColorizeProgram(const std::string& defines) {
+    GLuint program = linkProgram({
+        compileShader(GL_VERTEX_SHADER, {vertexShaderSource}),
+        compileShader(GL_FRAGMENT_SHADER, {glsl430, defines.c_str(), viewUniformsSource, histogramBinSource, coloringSource, colorizeShaderSource})
+    });
+    bindViewState(program);
+    return program;
+}
+
+#ifdef MANDEL_HAVE_COMPUTE
+GLuint buildComputeProgram(const std::string& defines) {
+    GLuint program = linkProgram({
+        compileShader(GL_COMPUTE_SHADER, {glsl430, defines.c_str(), viewUniformsSource, iterationSource, computeShaderSource})
+    });
+    bindViewState(program);
+    return program;
+}
+
+GLuint buildHistogramProgram(const std::string& defines) {
+    GLuint program = linkProgram({
+        compileShader(GL_COMPUTE_SHADER, {glsl430, defines.c_str(), viewUniformsSource, histogramBinSource, histogramShaderSource})
+    });
+    bindViewState(program);
+    return program;
+}
+
+GLuint buildScanProgram(const std::string& defines) {
+    return linkProgram({compileShader(GL_COMPUTE_SHADER, {glsl430, defines.c_str(), scanShaderSource})});
+}
+
+GLuint buildRefineFlagProgram(const std::string& defines) {
+    GLuint program = linkProgram({
+        compileShader(GL_COMPUTE_SHADER, {glsl430, defines.c_str(), viewUniformsSource, supersampleSource, refineFlagShaderSource})
+    });
+    bindViewState(program);
+    return program;
+}
+
+GLuint buildRefineProgram(const std::string& defines) {
+    GLuint program = linkProgram({
+        compileShader(GL_COMPUTE_SHADER, {glsl430, defines.c_str(), viewUniformsSource, iterationSource, supersampleSource, refineShaderSource})
+    });
+    bindViewState(program);
+    return program;
+}
+#endif
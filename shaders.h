@@ -0,0 +1,125 @@
+#pragma once
+
+#include "gl_includes.h"
+#include "colorize.h"
+#include "supersample.h"
+#include <cstddef>
+#include <functional>
+#include <initializer_list>
+#include <map>
+#include <string>
+
+// GLSL pieces shared by the viewer and the benchmark. Programs are assembled
+// from a #version line, VariantKey::defines() and the pieces they need.
+extern const char* vertexShaderSource;
+extern const char* viewUniformsSource;
+extern const char* iterationSource;
+extern const char* histogramBinSource;
+extern const char* coloringSource;
+extern const char* fragmentShaderSource;
+#ifdef MANDEL_HAVE_COMPUTE
+extern const char* computeShaderSource;
+extern const char* histogramShaderSource;
+extern const char* scanShaderSource;
+extern const char* supersampleSource;
+extern const char* refineFlagShaderSource;
+extern const char* refineShaderSource;
+#endif
+extern const char* colorizeShaderSource;
+extern const char* accumulateShaderSource;
+
+// CPU mirror of the ViewState block (std140 layout)
+struct ViewStateBlock {
+    double center[2];
+    double refOffset[2];
+    double zoom;
+    float resolution[2];
+    GLint maxIterations;
+    GLint orbitLength;
+    float jitter[2];
+};
+static_assert(offsetof(ViewStateBlock, refOffset) == 16, "std140 layout");
+static_assert(offsetof(ViewStateBlock, resolution) == 40, "std140 layout");
+static_assert(offsetof(ViewStateBlock, maxIterations) == 48, "std140 layout");
+static_assert(offsetof(ViewStateBlock, orbitLength) == 52, "std140 layout");
+static_assert(offsetof(ViewStateBlock, jitter) == 56, "std140 layout");
+
+const GLuint viewStateBinding = 0;
+const GLint orbitTextureUnit = 1;
+const GLint paletteTextureUnit = 2;
+
+// Compile-time options a program variant is specialized on
+struct VariantKey {
+    bool contrastEnhance = false;
+    bool perturb = false;
+    bool histogram = false;  // colorize program only: color from the compute path's CDF
+    bool supersample = false;  // colorize program only: blend in the refine pass's subsamples
+    bool distance = false;     // distance estimation and shading
+
+    int index() const { return (((contrastEnhance * 2 + perturb) * 2 + histogram) * 2 + supersample) * 2 + distance; }
+
+    std::string defines() const {
+        return std::string("#define CONTRAST_ENHANCE ") + (contrastEnhance ? "1" : "0") + "\n"
+             + "#define PERTURB " + (perturb ? "1" : "0") + "\n"
+             + "#define HISTOGRAM " + (histogram ? "1" : "0") + "\n"
+             + "#define HISTOGRAM_BINS " + std::to_string(histogramBins) + "\n"
+             + "#define HISTOGRAM_RANGE " + std::to_string(histogramRange) + "\n"
+             + "#define PALETTE_PERIOD " + std::to_string(palettePeriod) + "\n"
+             + "#define SUPERSAMPLE " + (supersample ? "1" : "0") + "\n"
+             + "#define SUPERSAMPLE_COUNT " + std::to_string(supersampleCount) + "\n"
+             + "#define SUPERSAMPLE_THRESHOLD " + std::to_string(supersampleThreshold) + "\n"
+             + "#define SUPERSAMPLE_DISTANCE " + std::to_string(supersampleDistance) + "\n"
+             + "#define DISTANCE " + (distance ? "1" : "0") + "\n"
+             + "#define DISTANCE_SHADE_WIDTH " + std::to_string(distanceShadeWidth) + "\n";
+    }
+};
+
+// Builds program variants on first use and keeps them for the rest of the session
+class ProgramVariants {
+public:
+    explicit ProgramVariants(std::function<GLuint(const std::string&)> build) : build(std::move(build)) {}
+
+    GLuint get(const VariantKey& key) {
+        auto it = programs.find(key.index());
+        if (it != programs.end()) return it->second;
+        GLuint program = build(key.defines());
+        programs[key.index()] = program;
+        return program;
+    }
+
+    bool has(const VariantKey& key) const { return programs.count(key.index()) != 0; }
+
+    void destroy() {
+        for (auto& entry : programs) glDeleteProgram(entry.second);
+        programs.clear();
+    }
+
+private:
+    std::function<GLuint(const std::string&)> build;
+    std::map<int, GLuint> programs;
+};
+
+GLuint compileShader(GLenum type, std::initializer_list<const char*> sources);
+GLuint linkProgram(std::initializer_list<GLuint> shaders);
+// Connects a freshly linked program to the ViewState block and the orbit and
+// palette texture units
+void bindViewState(GLuint program);
+// 1D RGB8 texture of a palette's entries, filtered and wrapped like Palette::sample
+GLuint createPaletteTexture(const Palette& palette);
+
+// Builders for ProgramVariants: iterate and color in one fragment pass, color
+// the compute kernel's iteration buffer, and the compute kernel itself
+GLuint buildFragmentProgram(const std::string& defines);
+GLuint buildColorizeProgram(const std::string& defines);
+// Not a variant: blends a finished frame into the temporal accumulation target
+GLuint buildAccumulateProgram();
+#ifdef MANDEL_HAVE_COMPUTE
+GLuint buildComputeProgram(const std::string& defines);
+// The two passes of histogram coloring: bin the iteration buffer, then scan the bins into the CDF
+GLuint buildHistogramProgram(const std::string& defines);
+GLuint buildScanProgram(const std::string& defines);
+// Adaptive supersampling: list the edge pixels, then iterate their subsamples
+// with an indirect dispatch sized by the first pass
+GLuint buildRefineFlagProgram(const std::string& defines);
+GLuint buildRefineProgram(const std::string& defines);
+#endif
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// Adaptive supersampling, shared by the CPU engine and the compute path (its
+// GLSL twin is supersampleSource in shaders.cpp). After the base image, pixels
+// whose smooth count differs from a neighbor's by more than the threshold get
+// supersampleCount extra samples, one jittered into each quarter of the pixel,
+// and are colored with the average of all their samples' colors.
+const int supersampleCount = 4;
+const float supersampleThreshold = 2.0f;
+// With distance estimates, exterior pixels at least this many pixels from the
+// set are never refined; their color varies too slowly to alias
+const float supersampleDistance = 2.0f;
+
+// Position of subsample k of pixel (x, y) within the pixel, in 0..1. The jitter
+// is a hash of the pixel and sample, so every engine picks the same positions.
+inline void subsampleOffset(int x, int y, int k, float& dx, float& dy) {
+    uint32_t h = (uint32_t)x * 0x8da6b343u ^ (uint32_t)y * 0xd8163841u ^ (uint32_t)k * 0xcb1ab31fu;
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    h *= 0x846ca68bu;
+    h ^= h >> 16;
+    dx = ((float)(k & 1) + (float)(h & 0xffffu) * (1.0f / 65536.0f)) * 0.5f;
+    dy = ((float)(k >> 1) + (float)(h >> 16) * (1.0f / 65536.0f)) * 0.5f;
+}
+
+// True if pixel (x, y) of a width x height buffer of smooth counts sits on an
+// edge worth refining. distance holds the pixels' distance estimates, or is null.
+inline bool needsSupersampling(const float* mu, const float* distance, int width, int height, int x, int y) {
+    static const int neighborX[4] = {-1, 1, 0, 0}, neighborY[4] = {0, 0, -1, 1};
+    if (distance && distance[(size_t)y * width + x] > supersampleDistance) return false;
+    float center = mu[(size_t)y * width + x];
+    for (int i = 0; i < 4; i++) {
+        int nx = x + neighborX[i], ny = y + neighborY[i];
+        if (nx < 0 || ny < 0 || nx >= width || ny >= height) continue;
+        if (std::abs(mu[(size_t)ny * width + nx] - center) > supersampleThreshold) return true;
+    }
+    return false;
+}
@@ -0,0 +1,334 @@
+#include "tile_protocol.h"
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#include "orbit.h"
+
+namespace {
+
+bool parseNumber(const std::string& token, double& value) {
+    char* end;
+    value = std::strtod(token.c_str(), &end);
+    return !token.empty() && *end == '\0' && std::isfinite(value);
+}
+
+bool parseInt(const std::string& token, int& value, int min, int max) {
+    char* end;
+    long parsed = std::strtol(token.c_str(), &end, 10);
+    if (token.empty() || *end != '\0' || parsed < min || parsed > max) return false;
+    value = (int)parsed;
+    return true;
+}
+
+// Splits "host:port"; an empty host means every interface
+bool splitTcpAddress(const std::string& address, std::string& host, std::string& port) {
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos) return false;
+    host = address.substr(0, colon);
+    port = address.substr(colon + 1);
+    return !port.empty();
+}
+
+int tcpSocket(const std::string& address, bool listening, bool quiet) {
+    std::string host, port;
+    if (!splitTcpAddress(address, host, port)) {
+        std::cerr << "Invalid address " << address << std::endl;
+        return -1;
+    }
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (listening) hints.ai_flags = AI_PASSIVE;
+    addrinfo* results;
+    int status = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &results);
+    if (status != 0) {
+        std::cerr << "Cannot resolve " << address << ": " << gai_strerror(status) << std::endl;
+        return -1;
+    }
+    int fd = -1;
+    int lastError = 0;
+    for (addrinfo* info = results; info && fd < 0; info = info->ai_next) {
+        fd = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+        if (fd < 0) continue;
+        int one = 1;
+        bool ok;
+        if (listening) {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            ok = bind(fd, info->ai_addr, info->ai_addrlen) == 0 && listen(fd, 64) == 0;
+        } else {
+            // Request lines are small and answered at once
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            ok = connect(fd, info->ai_addr, info->ai_addrlen) == 0;
+        }
+        if (!ok) {
+            lastError = errno;
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(results);
+    if (fd < 0 && !quiet) {
+        std::cerr << (listening ? "Failed to listen on " : "Failed to connect to ") << address << ": "
+                  << std::strerror(lastError) << std::endl;
+    }
+    return fd;
+}
+
+// A socket file left at path by a server that didn't shut down cleanly is
+// removed; anything else there, a live server's socket included, is kept and
+// makes listening fail
+bool clearStaleSocket(const std::string& path, const sockaddr_un& address) {
+    struct stat info;
+    if (lstat(path.c_str(), &info) != 0) return errno == ENOENT;
+    if (!S_ISSOCK(info.st_mode)) {
+        std::cerr << "Failed to listen on " << path << ": the file exists and is not a socket" << std::endl;
+        return false;
+    }
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe < 0) return false;
+    bool live = connect(probe, (const sockaddr*)&address, sizeof(address)) == 0;
+    int error = errno;
+    close(probe);
+    if (live) {
+        std::cerr << "Failed to listen on " << path << ": another server is listening there" << std::endl;
+        return false;
+    }
+    if (error != ECONNREFUSED) {
+        std::cerr << "Failed to listen on " << path << ": " << std::strerror(error) << std::endl;
+        return false;
+    }
+    return unlink(path.c_str()) == 0 || errno == ENOENT;
+}
+
+// A path starting with '@' names a socket in Linux's abstract namespace, which
+// has no file and goes away with the socket
+int unixSocket(const std::string& path, bool listening, bool quiet) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Socket path too long: " << path << std::endl;
+        return -1;
+    }
+    bool abstract = path[0] == '@';
+    std::memcpy(address.sun_path, path.data(), path.size());
+    if (abstract) address.sun_path[0] = '\0';
+    socklen_t length = abstract ? (socklen_t)(offsetof(sockaddr_un, sun_path) + path.size()) : sizeof(address);
+    if (listening && !abstract && !clearStaleSocket(path, address)) return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        std::cerr << "Failed to create a socket: " << std::strerror(errno) << std::endl;
+        return -1;
+    }
+    bool ok;
+    if (listening) {
+        ok = bind(fd, (const sockaddr*)&address, length) == 0 && listen(fd, 64) == 0;
+    } else {
+        ok = connect(fd, (const sockaddr*)&address, length) == 0;
+    }
+    if (!ok && !quiet) {
+        std::cerr << (listening ? "Failed to listen on " : "Failed to connect to ") << path << ": "
+                  << std::strerror(errno) << std::endl;
+    }
+    if (!ok) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+} // namespace
+
+size_t TileRequestHash::operator()(const TileRequest& request) const {
+    size_t h = std::hash<double>()(request.centerX);
+    for (size_t field : {std::hash<double>()(request.centerY), std::hash<double>()(request.zoom),
+                         (size_t)request.width, (size_t)request.height, (size_t)request.maxIterations,
+                         (size_t)request.palette, std::hash<double>()(request.colorZoom),
+                         (size_t)request.anchored, std::hash<double>()(request.anchorX),
+                         std::hash<double>()(request.anchorY)}) {
+        h ^= field + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+    }
+    return h;
+}
+
+std::string formatTileRequest(const TileRequest& request, const std::string& palette, bool png) {
+    char text[256];
+    std::snprintf(text, sizeof(text), "tile %a %a %a %d %d %d ", request.centerX, request.centerY, request.zoom,
+                  request.width, request.height, request.maxIterations);
+    std::string line = text + palette + (png ? " png" : " raw");
+    if (request.colorZoom > 0.0 || request.anchored) {
+        std::snprintf(text, sizeof(text), " %a", request.colorZoom > 0.0 ? request.colorZoom : request.zoom);
+        line += text;
+    }
+    if (request.anchored) {
+        std::snprintf(text, sizeof(text), " %a %a", request.anchorX, request.anchorY);
+        line += text;
+    }
+    return line;
+}
+
+bool parseTileRequest(const std::string& arguments, const std::function<int(const std::string&)>& paletteIndex,
+                      TileRequest& request, bool& png, std::string& error) {
+    std::istringstream in(arguments);
+    std::string centerX, centerY, zoom, width, height, iterations, palette, format, colorZoom, anchorX, anchorY, extra;
+    if (!(in >> centerX >> centerY >> zoom >> width >> height >> iterations >> palette >> format)
+        || (in >> colorZoom && in >> anchorX && !(in >> anchorY)) || in >> extra) {
+        error = "usage: tile <centerX> <centerY> <zoom> <width> <height> <maxIterations> <palette> <raw|png>"
+                " [colorZoom [anchorX anchorY]]";
+        return false;
+    }
+    if (!parseNumber(centerX, request.centerX) || !parseNumber(centerY, request.centerY)) {
+        error = "invalid center";
+        return false;
+    }
+    if (!parseNumber(zoom, request.zoom) || request.zoom <= 0.0) {
+        error = "invalid zoom";
+        return false;
+    }
+    if (!parseInt(width, request.width, 1, maxTileSize) || !parseInt(height, request.height, 1, maxTileSize)) {
+        error = "size must be 1 to " + std::to_string(maxTileSize);
+        return false;
+    }
+    if (!parseInt(iterations, request.maxIterations, 1, maxTileIterations)) {
+        error = "maxIterations must be 1 to " + std::to_string(maxTileIterations);
+        return false;
+    }
+    request.palette = paletteIndex(palette);
+    if (request.palette < 0) {
+        error = "unknown palette " + palette;
+        return false;
+    }
+    if (format != "raw" && format != "png") {
+        error = "format must be raw or png";
+        return false;
+    }
+    png = format == "png";
+    request.colorZoom = 0.0;
+    if (!colorZoom.empty() && (!parseNumber(colorZoom, request.colorZoom) || request.colorZoom <= 0.0)) {
+        error = "invalid colorZoom";
+        return false;
+    }
+    request.anchored = !anchorX.empty();
+    if (request.anchored) {
+        if (!parseNumber(anchorX, request.anchorX) || !parseNumber(anchorY, request.anchorY)) {
+            error = "invalid anchor";
+            return false;
+        }
+        if (std::hypot(request.anchorX - request.centerX, request.anchorY - request.centerY)
+            > orbitValidExtent * request.zoom) {
+            error = "anchor too far from the center";
+            return false;
+        }
+    }
+    return true;
+}
+
+bool isTcpAddress(const std::string& address) {
+    return address.find('/') == std::string::npos && address.find(':') != std::string::npos;
+}
+
+int listenOn(const std::string& address) {
+    return isTcpAddress(address) ? tcpSocket(address, true, false) : unixSocket(address, true, false);
+}
+
+int connectTo(const std::string& address) {
+    return isTcpAddress(address) ? tcpSocket(address, false, false) : unixSocket(address, false, false);
+}
+
+bool acceptsConnections(const std::string& address) {
+    int fd = isTcpAddress(address) ? tcpSocket(address, false, true) : unixSocket(address, false, true);
+    if (fd < 0) return false;
+    close(fd);
+    return true;
+}
+
+int acceptConnection(int listener) {
+    int fd = accept(listener, nullptr, nullptr);
+    if (fd >= 0) {
+        // Fails harmlessly on Unix domain sockets
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return fd;
+}
+
+bool sendAll(int fd, const void* data, size_t size) {
+    const char* bytes = (const char*)data;
+    while (size > 0) {
+        ssize_t sent = send(fd, bytes, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return false;
+        bytes += sent;
+        size -= (size_t)sent;
+    }
+    return true;
+}
+
+bool sendLine(int fd, const std::string& line) {
+    std::string text = line + "\n";
+    return sendAll(fd, text.data(), text.size());
+}
+
+bool LineReader::fill() {
+    // Drop what was consumed before growing the buffer
+    if (start > 0) {
+        buffer.erase(buffer.begin(), buffer.begin() + start);
+        start = 0;
+    }
+    char chunk[4096];
+    while (true) {
+        ssize_t received = recv(fd, chunk, sizeof(chunk), 0);
+        if (received < 0 && errno == EINTR) continue;
+        if (received <= 0) return false;
+        buffer.insert(buffer.end(), chunk, chunk + received);
+        return true;
+    }
+}
+
+bool LineReader::readLine(std::string& line, size_t maxLength) {
+    size_t scanned = 0;  // unread bytes already searched for the newline
+    while (true) {
+        auto newline = std::find(buffer.begin() + start + scanned, buffer.end(), '\n');
+        if (newline != buffer.end()) {
+            line.assign(buffer.begin() + start, newline);
+            start = newline - buffer.begin() + 1;
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            return true;
+        }
+        scanned = buffer.size() - start;
+        if (scanned > maxLength || !fill()) return false;
+    }
+}
+
+bool LineReader::read(void* data, size_t size) {
+    char* out = (char*)data;
+    size_t n = std::min(size, buffer.size() - start);
+    std::copy_n(buffer.begin() + start, n, out);
+    start += n;
+    out += n;
+    size -= n;
+    // The rest, which is most of a tile, skips the buffer
+    while (size > 0) {
+        ssize_t received = recv(fd, out, size, 0);
+        if (received < 0 && errno == EINTR) continue;
+        if (received <= 0) return false;
+        out += received;
+        size -= (size_t)received;
+    }
+    return true;
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "view_params.h"
+
+// The line protocol of mandel-server (described in mandel_server.cpp), and the
+// socket plumbing shared by the server and the mandel-render coordinator.
+
+struct TileRequest {
+    double centerX = 0.0, centerY = 0.0;
+    double zoom = 1.0;
+    int width = 0, height = 0;
+    int maxIterations = 0;
+    int palette = 0;  // index into the server's palettes
+    // Zoom the contrast-enhanced coloring is based on, so the tiles of a larger
+    // image color up like the image; 0 means zoom
+    double colorZoom = 0.0;
+    // Point the tile's reference orbit is iterated at, within orbitValidExtent
+    // zooms of the center. Tiles that share an anchor share one orbit, and the
+    // pixels come out the same whichever tiles a server rendered before; without
+    // an anchor the server takes any orbit that covers the tile.
+    bool anchored = false;
+    double anchorX = 0.0, anchorY = 0.0;
+
+    // The tile as a view; the server always enhances contrast
+    ViewParams view() const {
+        ViewParams view;
+        view.centerX = centerX;
+        view.centerY = centerY;
+        view.zoom = zoom;
+        view.width = width;
+        view.height = height;
+        view.maxIterations = maxIterations;
+        view.palette = palette;
+        view.contrastEnhance = true;
+        view.colorZoom = colorZoom;
+        return view;
+    }
+
+    bool operator==(const TileRequest& other) const {
+        return centerX == other.centerX && centerY == other.centerY && zoom == other.zoom
+            && width == other.width && height == other.height && maxIterations == other.maxIterations
+            && palette == other.palette && colorZoom == other.colorZoom && anchored == other.anchored
+            && anchorX == other.anchorX && anchorY == other.anchorY;
+    }
+};
+
+struct TileRequestHash {
+    size_t operator()(const TileRequest& request) const;
+};
+
+// Limits on what a single request may ask for
+const int maxTileSize = 4096;
+const int maxTileIterations = 1 << 24;
+const size_t maxRequestLine = 1024;
+
+// "tile ..." line for request, without the newline. Coordinates go out as hex
+// floats so the server sees exactly the same doubles. palette is the palette's
+// number (1-based) or name.
+std::string formatTileRequest(const TileRequest& request, const std::string& palette, bool png);
+
+// Parses the arguments after "tile". paletteIndex maps a palette number or
+// name to an index, or -1 if there is no such palette. On failure error says
+// what is wrong.
+bool parseTileRequest(const std::string& arguments, const std::function<int(const std::string&)>& paletteIndex,
+                      TileRequest& request, bool& png, std::string& error);
+
+// Addresses are "host:port" for TCP (":port" listens on every interface) or a
+// path for a Unix domain socket, "@name" for one without a file. Both return a
+// file descriptor, or -1 after printing why.
+int listenOn(const std::string& address);
+int connectTo(const std::string& address);
+bool isTcpAddress(const std::string& address);
+// True if a connection to address succeeds, which is once a server there
+// listens; prints nothing
+bool acceptsConnections(const std::string& address);
+// accept(), with TCP connections set up like connectTo()'s
+int acceptConnection(int listener);
+
+// Writes all of data, retrying short writes; false once the peer is gone
+bool sendAll(int fd, const void* data, size_t size);
+bool sendLine(int fd, const std::string& line);
+
+// Buffered reads of protocol lines and the payloads that follow them
+class LineReader {
+public:
+    explicit LineReader(int fd) : fd(fd) {}
+
+    // Next line without its newline (or carriage return). False on end of
+    // stream, error, or a line longer than maxLength.
+    bool readLine(std::string& line, size_t maxLength = maxRequestLine);
+    // Exactly size bytes
+    bool read(void* data, size_t size);
+
+private:
+    bool fill();
+
+    int fd;
+    std::vector<char> buffer;
+    size_t start = 0;  // first unread byte of buffer
+};
@@ -0,0 +1,166 @@
+#include "tile_scheduler.h"
+
+#include <algorithm>
+#include <numeric>
+#include <string>
+
+#include "trace.h"
+
+namespace {
+
+double msSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+TileScheduler::TileScheduler(int threadCount) {
+    if (threadCount <= 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 0; i < threadCount; i++) workers.push_back(std::make_unique<Worker>());
+    for (int i = 0; i < threadCount; i++) threads.emplace_back(&TileScheduler::workerLoop, this, i);
+}
+
+TileScheduler::~TileScheduler() {
+    wait();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& thread : threads) thread.join();
+}
+
+void TileScheduler::submit(std::vector<Tile> batchTiles, Work batchWork, StaleCheck batchStale) {
+    std::vector<int> order(batchTiles.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+        if (batchTiles[a].priority != batchTiles[b].priority) return batchTiles[a].priority < batchTiles[b].priority;
+        return batchTiles[a].cost > batchTiles[b].cost;
+    });
+
+    // Deal round-robin so every deque is itself in priority order
+    for (auto& worker : workers) {
+        worker->tasks.clear();
+        worker->busyMs = 0.0;
+        worker->finishMs = 0.0;
+        worker->steals = 0;
+    }
+    for (size_t i = 0; i < order.size(); i++) workers[i % workers.size()]->tasks.push_back(order[i]);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    tiles = std::move(batchTiles);
+    work = std::move(batchWork);
+    stale = std::move(batchStale);
+    cancelled = false;
+    cancelRequested = false;
+    batchStart = std::chrono::steady_clock::now();
+    runningWorkers = (int)workers.size();
+    batch++;
+    wake.notify_all();
+}
+
+bool TileScheduler::idle() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return runningWorkers == 0;
+}
+
+void TileScheduler::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [&] { return runningWorkers == 0; });
+}
+
+TileScheduler::Stats TileScheduler::lastStats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+void TileScheduler::cancel() {
+    cancelRequested = true;
+}
+
+void TileScheduler::run(const std::vector<Tile>& batchTiles, const Work& batchWork) {
+    submit(batchTiles, batchWork);
+    wait();
+}
+
+void TileScheduler::dropAll() {
+    for (auto& worker : workers) {
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        worker->tasks.clear();
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    cancelled = true;
+}
+
+bool TileScheduler::takeTask(int id, int& task) {
+    if (cancelRequested || (stale && stale())) {
+        dropAll();
+        return false;
+    }
+
+    Worker& own = *workers[id];
+    {
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = own.tasks.front();
+            own.tasks.pop_front();
+            return true;
+        }
+    }
+    for (size_t i = 1; i < workers.size(); i++) {
+        Worker& victim = *workers[(id + i) % workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = victim.tasks.back();
+            victim.tasks.pop_back();
+            own.steals++;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Called by the last worker to finish, with mutex held
+void TileScheduler::collectStats() {
+    stats = Stats();
+    stats.wallMs = msSince(batchStart);
+    double busy = 0.0, firstIdle = stats.wallMs, lastDone = 0.0;
+    for (auto& worker : workers) {
+        busy += worker->busyMs;
+        firstIdle = std::min(firstIdle, worker->finishMs);
+        lastDone = std::max(lastDone, worker->finishMs);
+        stats.steals += worker->steals;
+    }
+    if (stats.wallMs > 0.0) stats.utilization = busy / (stats.wallMs * workers.size());
+    stats.tailMs = lastDone - firstIdle;
+    stats.cancelled = cancelled;
+}
+
+void TileScheduler::workerLoop(int id) {
+    long seenBatch = 0;
+    Worker& self = *workers[id];
+    traceThreadName("tile worker " + std::to_string(id));
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || batch != seenBatch; });
+            if (stopping) return;
+            seenBatch = batch;
+        }
+
+        int task;
+        while (takeTask(id, task)) {
+            auto start = std::chrono::steady_clock::now();
+            TRACE_SCOPE("tile", "ring", tiles[task].priority);
+            work(tiles[task], id);
+            self.busyMs += msSince(start);
+        }
+        self.finishMs = msSince(batchStart);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--runningWorkers == 0) {
+            collectStats();
+            finished.notify_all();
+        }
+    }
+}
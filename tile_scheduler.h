@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct Tile {
+    int x = 0, y = 0;
+    int width = 0, height = 0;
+    int priority = 0;   // lower runs first
+    double cost = 0.0;  // estimated iterations; orders tiles of equal priority
+};
+
+// Fixed pool of worker threads running one batch of tiles at a time. Tiles are
+// dealt in priority order, most expensive first within a priority, into one
+// deque per worker. A worker takes from the front of its own deque. Once it runs
+// dry it steals from the back of the others', where the cheap tiles are. The
+// expensive tiles therefore start early and the tail of the frame is made of
+// small pieces that balance well.
+class TileScheduler {
+public:
+    explicit TileScheduler(int threadCount = 0);  // 0: one per hardware thread
+    ~TileScheduler();
+
+    TileScheduler(const TileScheduler&) = delete;
+    TileScheduler& operator=(const TileScheduler&) = delete;
+
+    using Work = std::function<void(const Tile& tile, int worker)>;
+    // Checked by the workers between tiles; once it returns true the rest of
+    // the batch is dropped
+    using StaleCheck = std::function<bool()>;
+
+    // Starts a batch in the background. The previous batch must be idle().
+    void submit(std::vector<Tile> tiles, Work work, StaleCheck stale = nullptr);
+    bool idle();
+    void wait();
+    // Drops the tiles of the running batch that have not started yet
+    void cancel();
+
+    // submit() followed by wait()
+    void run(const std::vector<Tile>& tiles, const Work& work);
+
+    int threadCount() const { return (int)workers.size(); }
+
+    struct Stats {
+        double wallMs = 0.0;
+        double utilization = 0.0;  // busy time over wall time, across all workers
+        double tailMs = 0.0;       // first worker out of work to last tile finished
+        int steals = 0;
+        bool cancelled = false;    // the batch went stale before all tiles ran
+    };
+    // Stats of the last batch that finished
+    Stats lastStats();
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<int> tasks;
+        double busyMs = 0.0;
+        double finishMs = 0.0;
+        int steals = 0;
+    };
+
+    void workerLoop(int id);
+    bool takeTask(int id, int& task);
+    void dropAll();
+    void collectStats();
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+
+    std::mutex mutex;
+    std::condition_variable wake, finished;
+    long batch = 0;  // bumped for every submit(); workers wait for it to change
+    int runningWorkers = 0;
+    bool stopping = false;
+
+    std::vector<Tile> tiles;
+    Work work;
+    StaleCheck stale;
+    bool cancelled = false;  // guarded by mutex
+    std::atomic<bool> cancelRequested{false};
+    std::chrono::steady_clock::time_point batchStart;
+    Stats stats;
+};
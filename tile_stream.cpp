@@ -0,0 +1,91 @@
+#include "tile_stream.h"
+
+#include <cstring>
+#include <iostream>
+
+void TileStream::init() {
+#ifdef MANDEL_HAVE_BUFFER_STORAGE
+    GLint major = 0, minor = 0, extensions = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    mapped = major > 4 || (major == 4 && minor >= 4);
+    glGetIntegerv(GL_NUM_EXTENSIONS, &extensions);
+    for (GLint i = 0; i < extensions && !mapped; i++)
+        mapped = std::strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), "GL_ARB_buffer_storage") == 0;
+    if (mapped) glGenBuffers(2, buffers);
+#endif
+}
+
+void TileStream::destroy() {
+    for (int i = 0; i < 2; i++) {
+        if (fences[i]) glDeleteSync(fences[i]);
+        fences[i] = 0;
+        mappings[i] = nullptr;
+        capacity[i] = 0;
+    }
+    // Deleting a buffer unmaps it
+    if (mapped) glDeleteBuffers(2, buffers);
+    mapped = false;
+}
+
+void TileStream::wait(int index) {
+    if (!fences[index]) return;
+    GLenum status;
+    do {
+        status = glClientWaitSync(fences[index], GL_SYNC_FLUSH_COMMANDS_BIT, 100000000);
+    } while (status == GL_TIMEOUT_EXPIRED);
+    glDeleteSync(fences[index]);
+    fences[index] = 0;
+}
+
+uint8_t* TileStream::next(int width, int height) {
+    if (!mapped) return nullptr;
+    current = 1 - current;
+    wait(current);
+
+    size_t size = (size_t)width * height * 3;
+    if (size > capacity[current]) {
+#ifdef MANDEL_HAVE_BUFFER_STORAGE
+        // Storage is immutable, so a larger frame takes a new buffer
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glDeleteBuffers(1, &buffers[current]);
+        glGenBuffers(1, &buffers[current]);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffers[current]);
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, NULL, flags);
+        mappings[current] = (uint8_t*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        capacity[current] = size;
+#endif
+        if (!mappings[current]) {
+            std::cerr << "Could not map a pixel buffer, uploading CPU frames from client memory" << std::endl;
+            destroy();
+            return nullptr;
+        }
+    }
+    return mappings[current];
+}
+
+void TileStream::waitForUploads() {
+    if (mapped) wait(current);
+}
+
+void TileStream::upload(GLuint texture, const uint8_t* pixels, int width, const std::vector<Tile>& tiles) {
+    if (tiles.empty()) return;
+    // From the mapped buffer the pointers become offsets into it
+    bool fromBuffer = mapped && pixels == mappings[current];
+    if (fromBuffer) glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffers[current]);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, width);
+    for (const Tile& tile : tiles) {
+        size_t offset = ((size_t)tile.y * width + tile.x) * 3;
+        const void* data = fromBuffer ? (const void*)offset : pixels + offset;
+        glTexSubImage2D(GL_TEXTURE_2D, 0, tile.x, tile.y, tile.width, tile.height, GL_RGB, GL_UNSIGNED_BYTE, data);
+    }
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    if (fromBuffer) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        if (fences[current]) glDeleteSync(fences[current]);
+        fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+}
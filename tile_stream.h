@@ -0,0 +1,49 @@
+#pragma once
+
+#include "gl_includes.h"
+
+#include <cstdint>
+#include <vector>
+
+#include "tile_scheduler.h"
+
+// Double-buffered staging for CPU frames on their way into a texture. Each
+// CPU job renders straight into one of two persistently mapped pixel buffers
+// while the texture is fed from tiles already finished, so every upload is a
+// copy the GPU does on its own time from memory it can already see, and a
+// finished tile is on screen the next frame. A new job takes the other
+// buffer; a fence after each frame's uploads says when the GPU is done
+// reading a buffer, which is long past by the time a job comes back to it.
+//
+// Without buffer storage (GL 4.1 contexts, macOS) next() returns null, jobs
+// render into their own memory and tiles upload from there as before.
+class TileStream {
+public:
+    void init();
+    // Once no job renders into the buffers any more
+    void destroy();
+
+    bool persistent() const { return mapped; }
+
+    // Switches to the other buffer for a width x height frame, once the GPU
+    // has read everything uploaded from it, and returns its mapping for a job
+    // to render into; null without buffer storage
+    uint8_t* next(int width, int height);
+    // Waits for the uploads from the current buffer, before a job rewrites
+    // pixels it already handed over
+    void waitForUploads();
+
+    // Copies tiles of a width-wide frame into texture. pixels is what next()
+    // returned, or the job's own memory if that was null.
+    void upload(GLuint texture, const uint8_t* pixels, int width, const std::vector<Tile>& tiles);
+
+private:
+    void wait(int index);
+
+    bool mapped = false;
+    int current = 0;
+    GLuint buffers[2] = {};
+    uint8_t* mappings[2] = {};
+    size_t capacity[2] = {};
+    GLsync fences[2] = {};
+};
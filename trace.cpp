@@ -0,0 +1,134 @@
+#include "trace.h"
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> traceEnabled{false};
+
+namespace {
+
+struct TraceEvent {
+    const char* name;
+    const char* argName;
+    int64_t argValue;
+    uint64_t startNs, endNs;
+};
+
+// Written only by its thread, read only by the flushing thread
+struct TraceBuffer {
+    static const uint32_t capacity = 1 << 14;
+    TraceEvent events[capacity];
+    std::atomic<uint32_t> head{0};  // next slot the owner writes
+    std::atomic<uint32_t> tail{0};  // next slot the flush reads
+    std::atomic<uint64_t> dropped{0};
+    int tid = 0;
+    std::string name;  // guarded by registryMutex
+};
+
+// Buffers are registered once per thread and live until exit, so a thread
+// that has finished still has its last events flushed
+std::mutex registryMutex;
+std::vector<std::unique_ptr<TraceBuffer>> registry;
+
+FILE* traceFile = nullptr;
+bool firstEvent = true;
+uint64_t traceBase = 0;
+
+TraceBuffer& threadBuffer() {
+    thread_local TraceBuffer* buffer = nullptr;
+    if (!buffer) {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        registry.push_back(std::make_unique<TraceBuffer>());
+        buffer = registry.back().get();
+        buffer->tid = (int)registry.size();
+    }
+    return *buffer;
+}
+
+void writeSeparator() {
+    std::fputs(firstEvent ? "\n" : ",\n", traceFile);
+    firstEvent = false;
+}
+
+} // namespace
+
+uint64_t traceNow() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void traceRecord(const char* name, uint64_t startNs, uint64_t endNs, const char* argName, int64_t argValue) {
+    if (!traceEnabled.load(std::memory_order_relaxed)) return;
+    TraceBuffer& buffer = threadBuffer();
+    uint32_t head = buffer.head.load(std::memory_order_relaxed);
+    if (head - buffer.tail.load(std::memory_order_acquire) >= TraceBuffer::capacity) {
+        buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    buffer.events[head % TraceBuffer::capacity] = {name, argName, argValue, startNs, endNs};
+    buffer.head.store(head + 1, std::memory_order_release);
+}
+
+bool traceStart(const std::string& path) {
+    traceFile = std::fopen(path.c_str(), "w");
+    if (!traceFile) {
+        std::cerr << "Failed to open trace file " << path << std::endl;
+        return false;
+    }
+    std::fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", traceFile);
+    firstEvent = true;
+    traceBase = traceNow();
+    traceEnabled = true;
+    return true;
+}
+
+void traceFlush() {
+    if (!traceFile) return;
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (auto& buffer : registry) {
+        uint32_t tail = buffer->tail.load(std::memory_order_relaxed);
+        uint32_t head = buffer->head.load(std::memory_order_acquire);
+        for (; tail != head; tail++) {
+            const TraceEvent& event = buffer->events[tail % TraceBuffer::capacity];
+            writeSeparator();
+            std::fprintf(traceFile, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+                         event.name, buffer->tid, (double)(int64_t)(event.startNs - traceBase) * 1e-3,
+                         (double)(event.endNs - event.startNs) * 1e-3);
+            if (event.argName) std::fprintf(traceFile, ",\"args\":{\"%s\":%" PRId64 "}", event.argName, event.argValue);
+            std::fputc('}', traceFile);
+        }
+        buffer->tail.store(tail, std::memory_order_release);
+    }
+}
+
+void traceStop() {
+    if (!traceFile) return;
+    traceEnabled = false;
+    traceFlush();
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    uint64_t dropped = 0;
+    for (auto& buffer : registry) {
+        dropped += buffer->dropped.load();
+        if (buffer->name.empty()) continue;
+        writeSeparator();
+        std::fprintf(traceFile, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                     buffer->tid, buffer->name.c_str());
+    }
+    std::fputs("\n]}\n", traceFile);
+    std::fclose(traceFile);
+    traceFile = nullptr;
+    if (dropped) std::cerr << "Trace dropped " << dropped << " events; flush more often" << std::endl;
+}
+
+void traceThreadName(const std::string& name) {
+    if (!traceEnabled) return;
+    TraceBuffer& buffer = threadBuffer();
+    std::lock_guard<std::mutex> lock(registryMutex);
+    buffer.name = name;
+}
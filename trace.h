@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Timeline of scoped events in Chrome trace JSON, for chrome://tracing or
+// ui.perfetto.dev. Every thread records complete events into its own
+// single-producer ring without locking. traceFlush(), called from one thread
+// (the viewer calls it once per frame), drains the rings into the file. A
+// ring that fills up between flushes drops events and counts them. While
+// tracing is off a scope costs one relaxed load.
+
+bool traceStart(const std::string& path);
+// Writes the events recorded since the last flush
+void traceFlush();
+// Flushes, names the threads and closes the file
+void traceStop();
+// Label for the calling thread's row in the timeline; ignored unless tracing
+void traceThreadName(const std::string& name);
+
+extern std::atomic<bool> traceEnabled;
+
+uint64_t traceNow();  // nanoseconds, steady clock
+void traceRecord(const char* name, uint64_t startNs, uint64_t endNs, const char* argName, int64_t argValue);
+
+// Records the lifetime of the scope. Names must be string literals (or outlive
+// the trace), as only the pointer is stored.
+class TraceScope {
+public:
+    explicit TraceScope(const char* name, const char* argName = nullptr, int64_t argValue = 0)
+        : name(name), argName(argName), argValue(argValue) {
+        if (traceEnabled.load(std::memory_order_relaxed)) start = traceNow();
+    }
+    ~TraceScope() {
+        if (start) traceRecord(name, start, traceNow(), argName, argValue);
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* name;
+    const char* argName;
+    int64_t argValue;
+    uint64_t start = 0;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+// TRACE_SCOPE("name") or TRACE_SCOPE("name", "argName", value)
+#define TRACE_SCOPE(...) TraceScope TRACE_CONCAT(traceScope, __LINE__)(__VA_ARGS__)
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <algorithm>
+
+// Below this zoom plain double iteration runs out of bits and every engine
+// switches to perturbation against a reference orbit
+const double perturbationZoom = 1e-9;
+
+// Everything that decides what a render shows, as one value. Renderers take it
+// by const reference and never keep a pointer to the caller's copy, so any
+// number of renders can run at once on views built from the same one. The
+// viewer's input handlers replace its current view with a changed copy
+// instead of editing it in place.
+struct ViewParams {
+    double centerX = -0.5, centerY = 0.0;
+    double zoom = 2.0;  // extent of the shorter side
+    int width = 800, height = 600;
+    int maxIterations = 256;
+    int palette = 0;  // index into the renderer's palettes
+    bool contrastEnhance = true;
+    // Zoom the contrast enhancement is based on, so the tiles of a larger image
+    // color up like the image; 0 means zoom
+    double colorZoom = 0.0;
+    bool histogram = false;   // color by the CDF of the escape counts
+    bool supersample = false;  // extra samples along edges
+    bool distanceEstimate = false;  // shade by the exterior distance estimate
+
+    bool perturbed() const { return zoom < perturbationZoom; }
+    double coloringZoom() const { return colorZoom > 0.0 ? colorZoom : zoom; }
+    // Width of a pixel in the complex plane
+    double pixelSize() const { return zoom / std::min(width, height); }
+
+    // The view zoomed by factor around the pixel (x, y), counted from the
+    // bottom-left, which stays where it is
+    ViewParams zoomedAt(double x, double y, double factor) const {
+        ViewParams view = *this;
+        double minRes = std::min(width, height);
+        double uvX = (x - 0.5 * width) / minRes;
+        double uvY = (y - 0.5 * height) / minRes;
+        view.zoom = zoom * factor;
+        view.centerX += uvX * (zoom - view.zoom);
+        view.centerY += uvY * (zoom - view.zoom);
+        return view;
+    }
+
+    // The view with its content moved by (dx, dy) pixels, y up
+    ViewParams pannedBy(double dx, double dy) const {
+        ViewParams view = *this;
+        double minRes = std::min(width, height);
+        view.centerX -= dx / minRes * zoom;
+        view.centerY -= dy / minRes * zoom;
+        return view;
+    }
+
+    ViewParams resized(int newWidth, int newHeight) const {
+        ViewParams view = *this;
+        view.width = newWidth;
+        view.height = newHeight;
+        return view;
+    }
+
+    ViewParams withIterations(int iterations) const {
+        ViewParams view = *this;
+        view.maxIterations = iterations;
+        return view;
+    }
+
+    bool operator==(const ViewParams& other) const {
+        return centerX == other.centerX && centerY == other.centerY && zoom == other.zoom
+            && width == other.width && height == other.height && maxIterations == other.maxIterations
+            && palette == other.palette && contrastEnhance == other.contrastEnhance
+            && colorZoom == other.colorZoom && histogram == other.histogram && supersample == other.supersample
+            && distanceEstimate == other.distanceEstimate;
+    }
+    bool operator!=(const ViewParams& other) const { return !(*this == other); }
+};